@@ -35,7 +35,14 @@ SOURCES += main.cpp\
     worlddialog.cpp \
     steveedit.cpp \
     stevehelp.cpp \
-    helpdialog.cpp
+    helpdialog.cpp \
+    worldarchive.cpp \
+    batchrunner.cpp \
+    renderbenchmark.cpp \
+    worldtrace.cpp \
+    replaydialog.cpp \
+    completionindex.cpp \
+    startuptimes.cpp
 
 HEADERS  += mainwindow.h \
     world.h \
@@ -49,7 +56,14 @@ HEADERS  += mainwindow.h \
     worlddialog.h \
     steveedit.h \
     stevehelp.h \
-    helpdialog.h
+    helpdialog.h \
+    worldarchive.h \
+    batchrunner.h \
+    renderbenchmark.h \
+    worldtrace.h \
+    replaydialog.h \
+    completionindex.h \
+    startuptimes.h
 
 FORMS    += mainwindow.ui \
     examplesdialog.ui \
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#include "batchrunner.h"
+
+//Part of every cache key, increased whenever the rows change
+static const int cache_version = 2;
+
+bool BatchRunner::setCodeFile(const QString &filename)
+{
+    QFile file{filename};
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    code = QString::fromUtf8(file.readAll()).split("\n");
+
+    return true;
+}
+
+//One line per result: key, tab, row
+bool BatchRunner::setCacheFile(const QString &filename)
+{
+    cache_file = filename;
+    cache.clear();
+
+    QFile file{filename};
+    if(!file.exists())
+        return true;
+
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    while(!file.atEnd())
+    {
+        const QByteArray line = file.readLine();
+        const int tab = line.indexOf('\t');
+        if(tab <= 0 || !line.endsWith('\n'))
+            continue; //Probably cut off while writing
+
+        cache[line.left(tab)] = QString::fromUtf8(line.mid(tab + 1, line.size() - tab - 2));
+    }
+
+    return true;
+}
+
+bool BatchRunner::addWorldFile(const QString &filename)
+{
+    QFile file{filename};
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    if(!WorldArchive::isArchive(file.peek(4)))
+    {
+        //Loaded when it's its turn
+        worlds.append({QFileInfo(filename).fileName(), filename, nullptr, QString()});
+        return true;
+    }
+
+    file.close();
+
+    //The archive stays open for all of its worlds
+    std::shared_ptr<WorldArchive> archive = std::make_shared<WorldArchive>();
+    if(!archive->loadFile(filename))
+        return false;
+
+    for(const QString &name : archive->getNames())
+        worlds.append({name, filename, archive, QString()});
+
+    return true;
+}
+
+bool BatchRunner::loadWorld(const BatchWorld &batch_world, World &world)
+{
+    if(batch_world.archive)
+        return batch_world.archive->loadWorld(batch_world.name, world);
+
+    return world.loadFile(batch_world.filename);
+}
+
+//The same world can be added twice, or two files can have the same name
+void BatchRunner::setTraceNames()
+{
+    QHash<QString, int> count;
+    for(const BatchWorld &batch_world : worlds)
+        count[batch_world.name]++;
+
+    for(int i = 0; i < worlds.size(); i++)
+    {
+        const QString &name = worlds[i].name;
+        worlds[i].trace_name = count[name] > 1 ? QString("%1.%2").arg(name).arg(i + 1) : name;
+    }
+}
+
+//The time depends on the machine and the load, a reused row shouldn't pretend it was measured now
+QString BatchRunner::cachedRow(const QString &row)
+{
+    QStringList columns = row.split('\t');
+    if(columns.size() > 4)
+        columns[4] = "0";
+
+    return columns.join("\t");
+}
+
+//line:function pairs (lines starting at 1), innermost first, separated by commas. The function is empty for the main program.
+//If the backtrace was too deep, "...:<number of missing entries>" is appended.
+QString BatchRunner::backtraceColumn(const QVector<BacktraceEntry> &backtrace, int depth)
+{
+    QStringList entries;
+    for(const BacktraceEntry &entry : backtrace)
+        entries.append(QString("%1:%2").arg(entry.line + 1).arg(entry.function));
+
+    if(depth > backtrace.size())
+        entries.append(QString("...:%1").arg(depth - backtrace.size()));
+
+    return entries.join(",");
+}
+
+//Fills row with everything after the name, returns false if the world failed.
+//cache_key is set if the row should be added to the cache.
+bool BatchRunner::runWorld(const BatchWorld &batch_world, World &world, SteveInterpreter &interpreter, QString &row, QByteArray &cache_key)
+{
+    QTextStream out{&row};
+
+    if(!loadWorld(batch_world, world))
+    {
+        out << "error\t0\t0\t0\t0\t\t\t" << QObject::trUtf8("Die Welt konnte nicht geladen werden.");
+        return false;
+    }
+
+    const bool tracing = !trace_directory.isEmpty();
+    if(!cache_file.isEmpty() && !tracing)
+    {
+        const QByteArray key = QCryptographicHash::hash(cache_prefix + world.toBinary(), QCryptographicHash::Sha1).toHex();
+        auto cached = cache.constFind(key);
+        if(cached != cache.constEnd())
+        {
+            row = *cached;
+            return row.startsWith("ok\t");
+        }
+
+        cache_key = key;
+    }
+
+    interpreter.reset();
+
+    TraceWriter trace;
+    const QString trace_file = QDir(trace_directory).filePath(batch_world.trace_name + ".sttrace");
+    if(tracing && !trace.open(trace_file, world, interpreter.getLine()))
+    {
+        out << "error\t0\t0\t0\t0\t\t\t" << QObject::trUtf8("Die Datei '%1' konnte nicht gespeichert werden!").arg(trace_file);
+        return false;
+    }
+
+    //No exceptions here, most failing programs fail in every world
+    QString result = "ok", message, backtrace;
+    int line = 0;
+    SteveError error;
+    bool success = true;
+    while(success && !interpreter.executionFinished())
+    {
+        success = interpreter.executeLine(error);
+        if(tracing)
+            trace.step(world, interpreter.getLine());
+    }
+
+    if(tracing && !trace.close())
+    {
+        out << "error\t0\t0\t0\t0\t\t\t" << QObject::trUtf8("Die Datei '%1' konnte nicht gespeichert werden!").arg(trace_file);
+        return false;
+    }
+
+    if(!success)
+    {
+        if(error.id == ERROR_ENDLESS_LOOP)
+            result = "loop";
+        else
+            result = interpreter.budgetExceeded() ? "limit" : "error";
+        if(error.id == ERROR_LIMIT_TIME)
+            cache_key.clear(); //Depends on the machine
+        line = error.line + 1;
+        message = interpreter.errorMessage(error).replace("\n", " ");
+        int depth;
+        QVector<BacktraceEntry> entries = interpreter.errorBacktrace(error, depth);
+        backtrace = backtraceColumn(entries, depth);
+    }
+
+    const ExecutionStatistics statistics = interpreter.getStatistics();
+    const QString hash = QString("%1").arg(world.getHash(), 16, 16, QChar('0'));
+    out << result << '\t' << line << '\t' << statistics.lines << '\t' << statistics.actions << '\t' << statistics.time_ms << '\t' << hash << '\t' << backtrace << '\t' << message;
+
+    return success;
+}
+
+int BatchRunner::run(QTextStream &out)
+{
+    //Parse once for all worlds
+    std::shared_ptr<const SteveProgram> program;
+    QString parse_error;
+    int parse_error_line = 0;
+    {
+        World world{5, 5, 5};
+        SteveInterpreter interpreter{&world};
+        try {
+            interpreter.setCode(code);
+            program = interpreter.getProgram();
+        }
+        catch (SteveInterpreterException &e)
+        {
+            parse_error = e.message().replace("\n", " ");
+            parse_error_line = e.getLine() + 1;
+        }
+    }
+
+    if(program && !cache_file.isEmpty())
+    {
+        cache_prefix = QString("%1 %2 %3 %4 %5\n").arg(cache_version).arg(budget.max_lines).arg(budget.max_actions).arg(budget.max_time_ms).arg(loop_detection).toUtf8();
+        cache_prefix += program->normalized();
+    }
+
+    if(!trace_directory.isEmpty())
+        setTraceNames();
+
+    std::vector<QString> rows(worlds.size());
+    std::vector<QByteArray> cache_keys(worlds.size());
+    std::atomic<int> next_world{0}, failed{0};
+
+    auto worker = [&] {
+        World world{5, 5, 5};
+        SteveInterpreter interpreter{&world};
+        interpreter.setBudget(budget);
+        interpreter.setFusion(trace_directory.isEmpty()); //Nobody watches, but traces need single actions
+        interpreter.setLoopDetection(loop_detection);
+        interpreter.setProgram(program);
+
+        for(int i = next_world++; i < worlds.size(); i = next_world++)
+        {
+            if(!program)
+            {
+                QTextStream{&rows[i]} << "error\t" << parse_error_line << "\t0\t0\t0\t\t\t" << parse_error;
+                failed++;
+            }
+            else if(!runWorld(worlds[i], world, interpreter, rows[i], cache_keys[i]))
+                failed++;
+        }
+    };
+
+    int thread_count = threads > 0 ? threads : QThread::idealThreadCount();
+    thread_count = std::max(1, std::min(thread_count, worlds.size()));
+
+    std::vector<std::thread> helpers;
+    for(int i = 1; i < thread_count; i++)
+        helpers.emplace_back(worker);
+
+    worker();
+
+    for(std::thread &helper : helpers)
+        helper.join();
+
+    for(int i = 0; i < worlds.size(); i++)
+        out << worlds[i].name << '\t' << rows[i] << '\n';
+
+    if(!cache_file.isEmpty())
+    {
+        QFile file{cache_file};
+        if(file.open(QIODevice::Append | QIODevice::Text))
+        {
+            for(int i = 0; i < worlds.size(); i++)
+            {
+                if(!cache_keys[i].isEmpty() && !cache.contains(cache_keys[i]))
+                {
+                    const QString row = cachedRow(rows[i]);
+                    cache[cache_keys[i]] = row;
+                    file.write(cache_keys[i] + '\t' + row.toUtf8() + '\n');
+                }
+            }
+        }
+    }
+
+    out.flush();
+
+    return failed == 0 ? 0 : 1;
+}
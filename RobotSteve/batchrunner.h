@@ -0,0 +1,66 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <memory>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QTextStream>
+
+#include "world.h"
+#include "worldarchive.h"
+#include "steveinterpreter.h"
+#include "worldtrace.h"
+
+//Runs one program against many worlds without GUI, for grading.
+//Prints one tab separated line per world:
+//name, result ("ok", "error", "limit" or "loop"), line of the error (starting at 1 like in the editor, 0 if none), executed lines, world actions, time in ms,
+//hash of the world at the end (World::getHash, hex), backtrace and message.
+//The code is parsed once, the worlds run in parallel, each thread with its own World and SteveInterpreter.
+//The output is always in the order the worlds were added.
+//With a cache file, rows are reused if the normalized program, the world and the limits are the same.
+//Rows from the cache have a time of 0 ms.
+class BatchRunner
+{
+public:
+    BatchRunner() {}
+
+    void setBudget(const ExecutionBudget &budget) { this->budget = budget; }
+    void setLoopDetection(bool enabled) { loop_detection = enabled; } //Stop programs as soon as they repeat a state
+    void setThreads(int threads) { this->threads = threads; } //0: QThread::idealThreadCount()
+    bool setCacheFile(const QString &filename); //Created if it doesn't exist
+    //Records every run into <directory>/<world name>.sttrace. Slower, instructions aren't fused and the cache isn't used.
+    //Worlds with the same name get their position (starting at 1) appended: <world name>.<position>.sttrace
+    void setTraceDirectory(const QString &directory) { trace_directory = directory; }
+    bool setCodeFile(const QString &filename);
+    bool addWorldFile(const QString &filename); //.stworld, .stworldb or .stworlda
+    int run(QTextStream &out);
+
+private:
+    struct BatchWorld {
+        QString name;
+        QString filename;
+        std::shared_ptr<WorldArchive> archive; //If set, name is the entry in the archive
+        QString trace_name; //Unique, set by run()
+    };
+
+    bool loadWorld(const BatchWorld &batch_world, World &world);
+    void setTraceNames();
+    bool runWorld(const BatchWorld &batch_world, World &world, SteveInterpreter &interpreter, QString &row, QByteArray &cache_key);
+    static QString cachedRow(const QString &row);
+    static QString backtraceColumn(const QVector<BacktraceEntry> &backtrace, int depth);
+
+    QStringList code;
+    QVector<BatchWorld> worlds;
+    ExecutionBudget budget;
+    bool loop_detection = false;
+    int threads = 0;
+    QString trace_directory;
+    QString cache_file;
+    QHash<QByteArray, QString> cache; //Key (hex) to row without time, read-only while running
+    QByteArray cache_prefix; //Program and limits, the world is appended for the key
+};
+
+#endif // BATCHRUNNER_H
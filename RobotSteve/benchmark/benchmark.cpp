@@ -0,0 +1,337 @@
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include "world.h"
+#include "steveinterpreter.h"
+
+/* Prints one JSON object to stdout:
+ * {"qt": "5.x.y", "benchmarks": [{"name": ..., "unit": ..., "iterations": ..., "ns_per_iteration": ..., "units_per_second": ...}, ...]}
+ * The order of the benchmarks and keys never changes, so results can be diffed.
+ * Usage: benchmark [--filter <part of name>] [--min-time <ms per round>] */
+
+struct BenchmarkResult {
+    QString name;
+    QString unit;
+    quint64 iterations;
+    qint64 ns_per_iteration;
+    qint64 units_per_second;
+};
+
+static QVector<BenchmarkResult> results;
+static QString filter;
+static qint64 min_time_ns = 200 * 1000 * 1000;
+
+//Runs function until a round takes at least min_time_ns, five rounds, reports the median.
+//function returns how many units (lines, actions, bytes, ...) it processed.
+static void benchmark(const QString &name, const QString &unit, std::function<quint64()> function)
+{
+    if(!filter.isEmpty() && !name.contains(filter))
+        return;
+
+    std::cerr << name.toStdString() << std::endl;
+
+    //Warm up and find out how many iterations a round needs
+    quint64 iterations = 1;
+    QElapsedTimer timer;
+    for(;;)
+    {
+        timer.start();
+        for(quint64 i = 0; i < iterations; i++)
+            function();
+
+        if(timer.nsecsElapsed() >= min_time_ns / 4 || iterations >= (1ull << 40))
+            break;
+
+        iterations *= 2;
+    }
+
+    QVector<qint64> ns_per_iteration;
+    QVector<qint64> units_per_second;
+    for(int round = 0; round < 5; round++)
+    {
+        quint64 units = 0;
+        timer.start();
+        for(quint64 i = 0; i < iterations; i++)
+            units += function();
+
+        qint64 ns = std::max<qint64>(timer.nsecsElapsed(), 1);
+        ns_per_iteration.append(ns / iterations);
+        units_per_second.append(static_cast<qint64>(units * 1e9 / ns));
+    }
+
+    std::sort(ns_per_iteration.begin(), ns_per_iteration.end());
+    std::sort(units_per_second.begin(), units_per_second.end());
+
+    results.append({name, unit, iterations, ns_per_iteration[2], units_per_second[2]});
+}
+
+static QStringList readCode(const QString &filename)
+{
+    QFile file{filename};
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        throw QString("Can't open %1").arg(filename);
+
+    return QString::fromUtf8(file.readAll()).split("\n");
+}
+
+//Runs the parsed code on a copy of the world until it's finished or max_lines calls to executeLine() were made
+static quint64 execute(SteveInterpreter &interpreter, World &world, const WorldState &start, quint64 max_lines)
+{
+    WorldState state = start;
+    world.setState(state);
+    interpreter.reset();
+
+    //getStatistics() looks at the clock, so it's only asked once after the loop
+    for(quint64 i = 0; i < max_lines && !interpreter.executionFinished(); i++)
+        interpreter.executeLine();
+
+    return interpreter.getStatistics().lines;
+}
+
+//Once line by line and once with fused instructions, like the batch runner does it
+static void benchmarkExecution(const QString &name, const QStringList &code, World &world, quint64 max_lines)
+{
+    SteveInterpreter interpreter{&world};
+    interpreter.setCode(code);
+    WorldState start = world.getState();
+
+    benchmark(name, "lines", [&] { return execute(interpreter, world, start, max_lines); });
+
+    interpreter.setFusion(true);
+    benchmark(name + "_fused", "lines", [&] { return execute(interpreter, world, start, max_lines); });
+
+    WorldState state = start;
+    world.setState(state);
+}
+
+//A program with many custom instructions and nested blocks
+static QStringList syntheticProgram(int instructions)
+{
+    QStringList code;
+    for(int i = 0; i < instructions; i++)
+    {
+        code << QString("anweisung a%1").arg(i)
+             << "    wiederhole 2 mal"
+             << "        wenn nicht wand dann"
+             << "            schritt"
+             << "        sonst"
+             << "            linksdrehen"
+             << "        *wenn"
+             << "    *wiederhole"
+             << "*anweisung"
+             << "";
+    }
+
+    for(int i = 0; i < instructions; i++)
+        code << QString("a%1").arg(i);
+
+    return code;
+}
+
+//Recursion as deep as the stack in front of Steve, which is restored afterwards
+static QStringList recursionProgram()
+{
+    return QStringList{}
+            << "anweisung tief"
+            << "    wenn ziegel dann"
+            << "        aufheben"
+            << "        tief"
+            << "        hinlegen"
+            << "    *wenn"
+            << "*anweisung"
+            << "tief";
+}
+
+static QStringList loopProgram()
+{
+    return QStringList{}
+            << "wiederhole 9999 mal"
+            << "    linksdrehen"
+            << "    wenn wand dann"
+            << "        rechtsdrehen"
+            << "    *wenn"
+            << "*wiederhole";
+}
+
+//Every field has something on it
+static void fillWorld(World &world)
+{
+    for(unsigned int x = 0; x < world.getSize().first; x++)
+        for(unsigned int y = 0; y < world.getSize().second; y++)
+        {
+            WorldObject &object = world.getObject({x, y});
+            object.stack_size = (x * 7 + y * 3) % 10;
+            object.has_mark = (x + y) % 3 == 0;
+            object.has_cube = object.stack_size == 0 && (x + y) % 4 == 1;
+        }
+
+    world.rehash();
+}
+
+static void runBenchmarks()
+{
+    const QStringList fibonacci = readCode(":/examples/Examples/fibonacci.steve"),
+            laufen = readCode(":/examples/Examples/laufen.steve"),
+            synthetic = syntheticProgram(200),
+            recursion = recursionProgram(),
+            loop = loopProgram();
+
+    World world{5, 5, 5};
+
+    //Parsing
+    {
+        SteveInterpreter interpreter{&world};
+        for(auto program : {std::make_pair(QString("fibonacci"), fibonacci), std::make_pair(QString("laufen"), laufen), std::make_pair(QString("synthetic"), synthetic)})
+        {
+            const QStringList &code = program.second;
+            benchmark("parse/" + program.first, "lines", [&] { interpreter.setCode(code); return static_cast<quint64>(code.size()); });
+        }
+    }
+
+    //Execution
+    if(!world.loadFile(":/examples/Examples/fibonacci.stworld"))
+        throw QString("Can't load fibonacci.stworld");
+    benchmarkExecution("execute/fibonacci", fibonacci, world, 1000000);
+
+    if(!world.loadFile(":/examples/Examples/laufen.stworld"))
+        throw QString("Can't load laufen.stworld");
+    benchmarkExecution("execute/laufen", laufen, world, 100000);
+
+    {
+        World deep{5, 5, 2000};
+        deep.deposit(2000);
+        benchmarkExecution("execute/recursion", recursion, deep, 1000000);
+    }
+
+    {
+        World open{25, 25, 10};
+        benchmarkExecution("execute/loop", loop, open, 1000000);
+    }
+
+    //World primitives
+    {
+        World open{25, 25, 10};
+        fillWorld(open);
+
+        benchmark("world/step", "actions", [&] {
+            if(open.frontBlocked())
+                open.turnRight(1);
+            else
+                open.stepForward();
+
+            return 1;
+        });
+
+        benchmark("world/turn", "actions", [&] { open.turnLeft(1); return 1; });
+
+        benchmark("world/deposit_pickup", "actions", [&] {
+            if(open.frontBlocked())
+                open.turnRight(1);
+
+            open.deposit(1);
+            open.pickup(1);
+            return 2;
+        });
+
+        benchmark("world/query", "queries", [&] {
+            volatile bool result = open.isWall() || open.isCube() || open.isMarked() || open.getStackSize() > 5;
+            Q_UNUSED(result);
+            return 4;
+        });
+
+        benchmark("world/state", "states", [&] {
+            WorldState state = open.getState();
+            open.setState(state);
+            return 1;
+        });
+    }
+
+    //Files
+    {
+        World big{25, 25, 10};
+        fillWorld(big);
+
+        const QString xml_file = QDir::temp().filePath(QString("robotsteve-benchmark-%1.stworld").arg(QCoreApplication::applicationPid()));
+        const QString binary_file = QDir::temp().filePath(QString("robotsteve-benchmark-%1.stworldb").arg(QCoreApplication::applicationPid()));
+
+        benchmark("file/save_xml", "bytes", [&] { big.saveFile(xml_file); return static_cast<quint64>(QFileInfo(xml_file).size()); });
+        benchmark("file/load_xml", "bytes", [&] { big.loadFile(xml_file); return static_cast<quint64>(QFileInfo(xml_file).size()); });
+        benchmark("file/save_binary", "bytes", [&] { big.saveBinaryFile(binary_file); return static_cast<quint64>(QFileInfo(binary_file).size()); });
+        benchmark("file/load_binary", "bytes", [&] { big.loadFile(binary_file); return static_cast<quint64>(QFileInfo(binary_file).size()); });
+
+        QFile::remove(xml_file);
+        QFile::remove(binary_file);
+    }
+}
+
+static void printResults(QTextStream &out)
+{
+    out << "{\n"
+        << "  \"qt\": \"" << qVersion() << "\",\n"
+        << "  \"benchmarks\": [\n";
+
+    for(int i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult &result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", "
+            << "\"unit\": \"" << result.unit << "\", "
+            << "\"iterations\": " << result.iterations << ", "
+            << "\"ns_per_iteration\": " << result.ns_per_iteration << ", "
+            << "\"units_per_second\": " << result.units_per_second << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+
+    out << "  ]\n"
+        << "}\n";
+
+    out.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a{argc, argv};
+
+    const QStringList arguments = QCoreApplication::arguments();
+    for(int i = 1; i < arguments.size(); i++)
+    {
+        if(arguments[i] == "--filter" && i + 1 < arguments.size())
+            filter = arguments[++i];
+        else if(arguments[i] == "--min-time" && i + 1 < arguments.size())
+            min_time_ns = arguments[++i].toLongLong() * 1000 * 1000;
+        else
+        {
+            std::cerr << "benchmark [--filter <part of name>] [--min-time <ms>]" << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        runBenchmarks();
+    }
+    catch (SteveInterpreterException &e) {
+        std::cerr << e.message().toStdString() << std::endl;
+        return 1;
+    }
+    catch (QString &s) {
+        std::cerr << s.toStdString() << std::endl;
+        return 1;
+    }
+    catch (std::string &s) {
+        std::cerr << s << std::endl;
+        return 1;
+    }
+
+    QTextStream out{stdout};
+    printResults(out);
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#-------------------------------------------------
+#
+# Microbenchmarks for the interpreter and the world,
+# built separately from the application:
+# qmake benchmark.pro && make && ./benchmark > results.json
+#
+#-------------------------------------------------
+
+QT += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4) {
+    CONFIG += c++11
+}
+
+lessThan(QT_MAJOR_VERSION, 5) {
+    QMAKE_CXXFLAGS += -std=c++11
+}
+
+macx {
+    QMAKE_CXXFLAGS += -mmacoxs-version-min=10.7 -std=c++11 -stdlib=libc++
+}
+
+TARGET = benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += benchmark.cpp \
+    ../world.cpp \
+    ../steveinterpreter.cpp
+
+HEADERS += ../world.h \
+    ../steveinterpreter.h
+
+RESOURCES += \
+    ../resources.qrc
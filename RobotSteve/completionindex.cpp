@@ -0,0 +1,100 @@
+#include "completionindex.h"
+
+CompletionIndex::CompletionIndex()
+{
+    nodes.push_back(Node{QChar(), -1, -1, 0, 0, QString()});
+}
+
+int CompletionIndex::child(int node, QChar c) const
+{
+    int child = nodes[node].first_child;
+    while(child != -1 && nodes[child].c < c)
+        child = nodes[child].next_sibling;
+
+    return child != -1 && nodes[child].c == c ? child : -1;
+}
+
+int CompletionIndex::find(const QString &word) const
+{
+    int node = 0;
+    for(int i = 0; i < word.length() && node != -1; i++)
+        node = child(node, word[i].toCaseFolded());
+
+    return node;
+}
+
+void CompletionIndex::insert(const QString &word)
+{
+    if(word.isEmpty())
+        return;
+
+    int node = 0;
+    nodes[0].words++;
+
+    for(int i = 0; i < word.length(); i++)
+    {
+        const QChar c = word[i].toCaseFolded();
+
+        int previous = -1, next = nodes[node].first_child;
+        while(next != -1 && nodes[next].c < c)
+        {
+            previous = next;
+            next = nodes[next].next_sibling;
+        }
+
+        if(next == -1 || nodes[next].c != c)
+        {
+            nodes.push_back(Node{c, -1, next, 0, 0, QString()});
+            next = nodes.size() - 1;
+
+            if(previous == -1)
+                nodes[node].first_child = next;
+            else
+                nodes[previous].next_sibling = next;
+        }
+
+        node = next;
+        nodes[node].words++;
+    }
+
+    if(nodes[node].count++ == 0)
+        nodes[node].word = word;
+}
+
+void CompletionIndex::remove(const QString &word)
+{
+    const int end = find(word);
+    if(end <= 0 || nodes[end].count == 0)
+        return;
+
+    nodes[end].count--;
+
+    int node = 0;
+    nodes[0].words--;
+    for(int i = 0; i < word.length(); i++)
+    {
+        node = child(node, word[i].toCaseFolded());
+        nodes[node].words--;
+    }
+}
+
+void CompletionIndex::collect(int node, int max, QStringList &result) const
+{
+    if(nodes[node].count > 0)
+        result.append(nodes[node].word);
+
+    for(int next = nodes[node].first_child; next != -1 && result.size() < max; next = nodes[next].next_sibling)
+        if(nodes[next].words > 0)
+            collect(next, max, result);
+}
+
+QStringList CompletionIndex::complete(const QString &prefix, int max) const
+{
+    QStringList result;
+
+    const int node = find(prefix);
+    if(node != -1 && max > 0 && nodes[node].words > 0)
+        collect(node, max, result);
+
+    return result;
+}
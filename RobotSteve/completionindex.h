@@ -0,0 +1,37 @@
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <vector>
+#include <QString>
+#include <QStringList>
+
+//Words for the completion in a prefix tree, case insensitive.
+//A word can be inserted more than once (e.g. the same custom instruction defined twice),
+//it's only gone after as many remove() calls.
+class CompletionIndex
+{
+public:
+    CompletionIndex();
+
+    void insert(const QString &word);
+    void remove(const QString &word);
+    //At most max words starting with prefix, sorted
+    QStringList complete(const QString &prefix, int max = 100) const;
+
+private:
+    struct Node {
+        QChar c; //Case folded
+        int first_child, next_sibling; //-1 if none, siblings sorted by c
+        int count; //How often the word ending here was inserted
+        int words; //Sum of count in this subtree, complete() skips it if 0
+        QString word; //As inserted first
+    };
+
+    int child(int node, QChar c) const;
+    int find(const QString &word) const;
+    void collect(int node, int max, QStringList &result) const;
+
+    std::vector<Node> nodes; //nodes[0] is the root. Removed words leave their nodes behind for the next insert().
+};
+
+#endif // COMPLETIONINDEX_H
@@ -85,6 +85,7 @@ void GLBox::draw()
     glColor4f(color.redF(), color.greenF(), color.blueF(), color.alphaF());
 
     glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+    draw_calls++;
 
     //Childs aligned on cen{X,Y,Z}
     glTranslatef(cenX, cenY, cenZ);
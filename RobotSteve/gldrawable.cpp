@@ -1,21 +1,30 @@
 #include <QGLWidget>
+#include <QImageReader>
 
 #include "gldrawable.h"
 
-TextureAtlas::TextureAtlas(QGLWidget &parent, QPixmap &&pixmap)
-    : parent{&parent}, pixmap{pixmap}
+quint64 GLDrawable::draw_calls = 0;
+
+TextureAtlas::TextureAtlas(QGLWidget &parent, const QString &filename)
+    : parent{&parent}, filename{filename}, size{QImageReader(filename).size()}
 {
 }
 
 TextureAtlasEntry TextureAtlas::getArea(int x, int y, int w, int h)
 {
-    float UperPx = 1.0 / pixmap.width();
-    float VperPx = 1.0 / pixmap.height();
+    float UperPx = 1.0 / size.width();
+    float VperPx = 1.0 / size.height();
 
     return {UperPx * x, VperPx * y, UperPx * (x+w), VperPx * (y+h)};
 }
 
 void TextureAtlas::bind()
 {
+    if(!loaded)
+    {
+        pixmap.load(filename);
+        loaded = true;
+    }
+
     glBindTexture(GL_TEXTURE_2D, parent->bindTexture(pixmap, GL_TEXTURE_2D, GL_RGBA, QGLContext::NoBindOption));
 }
@@ -10,15 +10,19 @@ struct TextureAtlasEntry {
     float bottom;
 };
 
+//The image is only decoded on the first bind(), getArea() just needs its size
 class TextureAtlas {
 public:
-    TextureAtlas(QGLWidget &parent, QPixmap &&pixmap);
+    TextureAtlas(QGLWidget &parent, const QString &filename);
     TextureAtlasEntry getArea(int x, int y, int w, int h);
     void bind();
 
 private:
     QGLWidget *parent;
+    QString filename;
+    QSize size;
     QPixmap pixmap;
+    bool loaded = false;
 };
 
 class GLDrawable
@@ -42,6 +46,8 @@ public:
 
     virtual void draw() = 0;
 
+    static quint64 draw_calls; //Counts every glDrawArrays, for the render benchmark
+
 protected:
     float posX = 0, posY = 0, posZ = 0;
     float rotX = 0, rotY = 0, rotZ = 0;
@@ -32,6 +32,7 @@ void GLQuad::draw()
     glTexCoordPointer(2, GL_FLOAT, 0, tex_coords.constData());
 
     glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+    draw_calls++;
 
     glPopMatrix();
 }
@@ -8,6 +8,7 @@
 #include <QInputDialog>
 
 #include "glworld.h"
+#include "startuptimes.h"
 
 #ifndef M_PI
 #define M_PI		3.14159265358979323846
@@ -34,8 +35,8 @@ GLWorld::GLWorld(unsigned int width, unsigned int length, unsigned int max_heigh
     anim_next.insert(ANIM_GREET2, ANIM_GREET3);
     anim_next.insert(ANIM_GREET3, ANIM_STANDING);
 
-    player_atlas = std::unique_ptr<TextureAtlas>(new TextureAtlas(*this, QPixmap(":/textures/char.png")));
-    environment_atlas = std::unique_ptr<TextureAtlas>(new TextureAtlas(*this, QPixmap(":/textures/environment.png")));
+    player_atlas = std::unique_ptr<TextureAtlas>(new TextureAtlas(*this, ":/textures/char.png"));
+    environment_atlas = std::unique_ptr<TextureAtlas>(new TextureAtlas(*this, ":/textures/environment.png"));
 
     //Scale of texture -> GL units
     const double m_per_px = 0.0579;
@@ -161,19 +162,34 @@ void GLWorld::paintGL()
     //Render to the FBO for color picking
     if(fbo_dirty)
     {
-        glClearColor(1, 1, 1, 1);
         fbo = std::unique_ptr<QGLFramebufferObject>(new QGLFramebufferObject(QGLWidget::size().width(), QGLWidget::size().height(), QGLFramebufferObject::Depth));
-        if(!fbo->hasOpenGLFramebufferObjects())
+        if(fbo->hasOpenGLFramebufferObjects())
         {
-            //Not supported
-            fbo_dirty = false;
-            return;
+            fbo->bind();
+            glClearColor(1, 1, 1, 1);
+            renderScene(true);
+            fbo->release();
+            click_image = fbo->toImage();
         }
-        fbo->bind();
+
+        //Less fps if the world is being changed or rotated, as the fbo has to be refreshed every time
+        fbo_dirty = false;
     }
-    else
-        qglClearColor(qApp->palette().color(QPalette::Window)); //Transparency effect
 
+    qglClearColor(qApp->palette().color(QPalette::Window)); //Transparency effect
+    renderScene(false);
+
+    if(!painted)
+    {
+        painted = true;
+        StartupTimes::mark("first frame"); //Includes decoding the textures
+    }
+}
+
+//Draws the world into the current framebuffer.
+//If picking is set, everything clickable is drawn untextured with its coordinates encoded as color.
+void GLWorld::renderScene(bool picking)
+{
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
 
@@ -191,7 +207,7 @@ void GLWorld::paintGL()
     glTranslated(-camera_calX, -camera_calY, -camera_calZ);
 
     //Using the color picking technique, every clickable object has its own unique color
-    if(fbo_dirty)
+    if(picking)
         glDisable(GL_TEXTURE_2D);
 
     else
@@ -219,7 +235,7 @@ void GLWorld::paintGL()
         {
             QColor floor_color = QColor(Qt::white).darker(150);
             //Encode coordinates as color value for use in the mouse click handler
-            if(fbo_dirty)
+            if(picking)
             {
                 floor_color.setRed(x);
                 floor_color.setGreen(z);
@@ -262,7 +278,7 @@ void GLWorld::paintGL()
                 unsigned int height = 0;
                 for(; height < obj.stack_size - 1; height++, brick_y += 0.5f)
                 {
-                    if(fbo_dirty)
+                    if(picking)
                         floor_color.setBlue(height + 1);
 
                     brick_mid->getColor() = floor_color;
@@ -270,7 +286,7 @@ void GLWorld::paintGL()
                     brick_mid->draw();
                 }
 
-                if(fbo_dirty)
+                if(picking)
                     floor_color.setBlue(height + 1);
 
                 brick_top->getColor() = floor_color;
@@ -281,7 +297,7 @@ void GLWorld::paintGL()
             }
         }
 
-    if(!fbo_dirty)
+    if(!picking)
     {
         glDisable(GL_CULL_FACE);
 
@@ -290,16 +306,6 @@ void GLWorld::paintGL()
     }
 
     glPopMatrix();
-
-    if(fbo_dirty)
-    {
-        fbo->release();
-        click_image = fbo->toImage();
-
-        //Render to the screen next time
-        fbo_dirty = false;
-        paintGL(); //Less fps if the world is being changed or rotated, as the fbo has to be refreshed every time
-    }
 }
 
 void GLWorld::initializeGL()
@@ -328,7 +334,7 @@ void GLWorld::resizeGL(int w, int h)
 
 void GLWorld::setPlayerTexture(const QString &filename)
 {
-    player_atlas = std::unique_ptr<TextureAtlas>(new TextureAtlas(*this, QPixmap(filename)));
+    player_atlas = std::unique_ptr<TextureAtlas>(new TextureAtlas(*this, filename));
 }
 
 inline float lin_terpolation(float from, float to, float x)
@@ -492,6 +498,7 @@ void GLWorld::mousePressEvent(QMouseEvent *event)
         emit changed();
     }
 
+    rehash();
     updateSelection();
 }
 
@@ -644,6 +651,10 @@ bool GLWorld::stepForward()
 
 void GLWorld::turnRight(int quarters)
 {
+    //Still facing the same way, don't animate a turn that didn't happen
+    if(quarters % 4 == 0)
+        return;
+
     World::turnRight(quarters);
     setAnimation(ANIM_TURN);
     updateAnimationTarget();
@@ -653,6 +664,10 @@ void GLWorld::turnRight(int quarters)
 
 void GLWorld::turnLeft(int quarters)
 {
+    //Still facing the same way, don't animate a turn that didn't happen
+    if(quarters % 4 == 0)
+        return;
+
     World::turnLeft(quarters);
     setAnimation(ANIM_TURN);
     updateAnimationTarget();
@@ -849,6 +864,19 @@ bool GLWorld::loadXMLStream(QXmlStreamReader &file_reader)
     return true;
 }
 
+bool GLWorld::loadBinary(const uchar *data, qint64 size)
+{
+    if(!World::loadBinary(data, size))
+        return false;
+
+    updateCamera();
+    updateAnimationTarget(true);
+
+    emit changed();
+
+    return true;
+}
+
 bool GLWorld::resize(unsigned int width, unsigned int length)
 {
     if(!World::resize(width, length))
@@ -862,6 +890,21 @@ bool GLWorld::resize(unsigned int width, unsigned int length)
     return true;
 }
 
+void GLWorld::replayed(ANIMATION animation)
+{
+    if(animation == ANIM_STANDING)
+        updateAnimationTarget(true);
+    else
+    {
+        setAnimation(animation);
+        updateAnimationTarget();
+    }
+
+    fbo_dirty = true;
+
+    emit changed();
+}
+
 void GLWorld::updateFront()
 {
     World::updateFront();
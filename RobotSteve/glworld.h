@@ -39,6 +39,9 @@ struct Selection {
 class GLWorld : public QGLWidget, public World
 {
     Q_OBJECT
+
+    friend class RenderBenchmark;
+
 public:
     explicit GLWorld(unsigned int width, unsigned int length, unsigned int max_height, QWidget *parent = 0);
 
@@ -53,7 +56,10 @@ public:
     bool pickup(unsigned int count) override;
     bool setState(WorldState &state) override;
     bool loadXMLStream(QXmlStreamReader &file_reader) override;
+    bool loadBinary(const uchar *data, qint64 size) override;
     void setPlayerTexture(const QString &filename);
+    //After placeSteve() and setObject() from a trace. ANIM_STANDING jumps to the new state.
+    void replayed(ANIMATION animation);
     bool isEditable() const { return editable; }
 
 protected:
@@ -79,6 +85,7 @@ signals:
     void changed();
     
 private:
+    void renderScene(bool picking);
     void drawWallX();
     void drawWallZ();
     void updateAnimationTarget(bool force_set = false);
@@ -86,6 +93,7 @@ private:
 
     std::unique_ptr<QGLFramebufferObject> fbo; //To find out what the user clicked on
     bool fbo_dirty = true; //Whether to redraw click_image
+    bool painted = false; //For StartupTimes
     QImage click_image; //Color coded version of the rendered image
     bool editable = true; //Whether the user is allowed to edit the world using the context menu
     Selection current_selection{TYPE_NOTHING, {0, 0}, 0};
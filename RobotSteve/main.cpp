@@ -1,12 +1,22 @@
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 #include <QApplication>
 #include <QTextCodec>
 #include <QStyleFactory>
+#include <QFile>
 #include <QFileInfo>
+#include <QDir>
 #include <QMessageBox>
+#include <QTextStream>
 
 #include "mainwindow.h"
 #include "steveinterpreter.h"
+#include "world.h"
+#include "worldarchive.h"
+#include "batchrunner.h"
+#include "renderbenchmark.h"
+#include "startuptimes.h"
 
 enum ARG_PARSE_STATE {
     NEXT_IS_SOMETHING,
@@ -14,6 +24,233 @@ enum ARG_PARSE_STATE {
     NEXT_IS_WORLD
 };
 
+//Converts between the XML (.stworld) and the binary (.stworldb) world format
+static int convertWorld(const QString &input, const QString &output)
+{
+    World world{5, 5, 5};
+    if(!world.loadFile(input))
+    {
+        std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(input).toStdString() << std::endl;
+        return 1;
+    }
+
+    bool saved;
+    if(QFileInfo(output).suffix().compare("stworldb", Qt::CaseInsensitive) == 0)
+        saved = world.saveBinaryFile(output);
+    else
+        saved = world.saveFile(output);
+
+    if(!saved)
+    {
+        std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht gespeichert werden!").arg(output).toStdString() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+//Modes which don't need a display:
+//--convert <input> <output>
+//--archive <output.stworlda> <worlds...>
+//--batch [limits] <program> <worlds or archives...>
+static bool isHeadlessMode(const char *argument)
+{
+    return strcmp(argument, "--convert") == 0 || strcmp(argument, "--archive") == 0 || strcmp(argument, "--batch") == 0;
+}
+
+static int runHeadless(const QStringList &arguments)
+{
+    const QString &mode = arguments[1];
+
+    if(mode == "--convert")
+    {
+        if(arguments.size() != 4)
+        {
+            std::cerr << "--convert <input> <output>" << std::endl;
+            return 1;
+        }
+
+        return convertWorld(arguments[2], arguments[3]);
+    }
+    else if(mode == "--archive")
+    {
+        if(arguments.size() < 4)
+        {
+            std::cerr << "--archive <output.stworlda> <worlds...>" << std::endl;
+            return 1;
+        }
+
+        WorldArchive archive;
+        for(int i = 3; i < arguments.size(); i++)
+        {
+            const QString name = QFileInfo(arguments[i]).fileName();
+            if(archive.contains(name))
+            {
+                std::cerr << QObject::trUtf8("Die Dateien '%1' und '%2' haben beide den Namen '%3'!").arg(archive.getFileOf(name)).arg(arguments[i]).arg(name).toStdString() << std::endl;
+                return 1;
+            }
+
+            if(!archive.addWorldFile(arguments[i]))
+            {
+                std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht hinzugefügt werden!").arg(arguments[i]).toStdString() << std::endl;
+                return 1;
+            }
+        }
+
+        if(!archive.saveFile(arguments[2]))
+        {
+            std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht gespeichert werden!").arg(arguments[2]).toStdString() << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+    else //--batch [--max-lines n] [--max-actions n] [--max-time ms] [--detect-loops] [--threads n] [--cache file] [--trace dir] <program> <worlds...>
+    {
+        BatchRunner runner;
+        ExecutionBudget budget;
+        QStringList files;
+
+        for(int i = 2; i < arguments.size(); i++)
+        {
+            const QString &argument = arguments[i];
+            if(argument == "--detect-loops")
+            {
+                runner.setLoopDetection(true);
+                continue;
+            }
+            else if(argument == "--trace" && i + 1 < arguments.size())
+            {
+                if(!QDir().mkpath(arguments[++i]))
+                {
+                    std::cerr << QObject::trUtf8("Das Verzeichnis '%1' konnte nicht erstellt werden!").arg(arguments[i]).toStdString() << std::endl;
+                    return 1;
+                }
+
+                runner.setTraceDirectory(arguments[i]);
+                continue;
+            }
+            else if(argument == "--cache" && i + 1 < arguments.size())
+            {
+                if(!runner.setCacheFile(arguments[++i]))
+                {
+                    std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(arguments[i]).toStdString() << std::endl;
+                    return 1;
+                }
+
+                continue;
+            }
+
+            bool is_limit = argument == "--max-lines" || argument == "--max-actions" || argument == "--max-time" || argument == "--threads";
+            if(!is_limit)
+            {
+                files.append(argument);
+                continue;
+            }
+
+            bool ok = false;
+            quint64 value = i + 1 < arguments.size() ? arguments[++i].toULongLong(&ok) : 0;
+            if(!ok)
+            {
+                std::cerr << QObject::trUtf8("%1 braucht eine Zahl.").arg(argument).toStdString() << std::endl;
+                return 1;
+            }
+
+            if(argument == "--max-lines")
+                budget.max_lines = value;
+            else if(argument == "--max-actions")
+                budget.max_actions = value;
+            else if(argument == "--threads")
+                runner.setThreads(static_cast<int>(value));
+            else
+                budget.max_time_ms = value;
+        }
+
+        if(files.size() < 2)
+        {
+            std::cerr << "--batch [--max-lines n] [--max-actions n] [--max-time ms] [--detect-loops] [--threads n] [--cache file] [--trace dir] <program> <worlds...>" << std::endl;
+            return 1;
+        }
+
+        runner.setBudget(budget);
+
+        if(!runner.setCodeFile(files[0]))
+        {
+            std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(files[0]).toStdString() << std::endl;
+            return 1;
+        }
+
+        for(int i = 1; i < files.size(); i++)
+        {
+            if(!runner.addWorldFile(files[i]))
+            {
+                std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(files[i]).toStdString() << std::endl;
+                return 1;
+            }
+        }
+
+        QTextStream out{stdout};
+        return runner.run(out);
+    }
+}
+
+//--render-benchmark [--frames n] [--size WxH] [--program file] [--picking] [world]
+//Without a world the worst case is rendered: 25x25, every field stacked up to 10 bricks.
+//Needs a display with OpenGL even though no window is shown, GLWorld is a QGLWidget.
+//On a server without one, run it inside a virtual X server: xvfb-run RobotSteve --render-benchmark
+static int runRenderBenchmark(const QStringList &arguments)
+{
+    GLWorld world{5, 5, 5};
+    RenderBenchmark benchmark{world};
+    QString world_file;
+
+    for(int i = 2; i < arguments.size(); i++)
+    {
+        const QString &argument = arguments[i];
+        const bool has_value = i + 1 < arguments.size();
+
+        if(argument == "--frames" && has_value)
+            benchmark.setFrames(std::max(1, arguments[++i].toInt()));
+        else if(argument == "--size" && has_value)
+        {
+            QStringList size = arguments[++i].split("x");
+            if(size.size() != 2 || size[0].toInt() <= 0 || size[1].toInt() <= 0)
+            {
+                std::cerr << QObject::trUtf8("Ungültige Größe: %1").arg(arguments[i]).toStdString() << std::endl;
+                return 1;
+            }
+
+            benchmark.setSize(size[0].toInt(), size[1].toInt());
+        }
+        else if(argument == "--program" && has_value)
+        {
+            QFile file{arguments[++i]};
+            if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            {
+                std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(arguments[i]).toStdString() << std::endl;
+                return 1;
+            }
+
+            benchmark.setCode(QString::fromUtf8(file.readAll()).split("\n"));
+        }
+        else if(argument == "--picking")
+            benchmark.setPicking(true);
+        else
+            world_file = argument;
+    }
+
+    if(world_file.isEmpty())
+        RenderBenchmark::fillWorstCase(world, 10);
+    else if(!world.loadFile(world_file))
+    {
+        std::cerr << QObject::trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(world_file).toStdString() << std::endl;
+        return 1;
+    }
+
+    QTextStream out{stdout};
+    return benchmark.run(out) ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {   
 #if QT_VERSION < QT_VERSION_CHECK(5,0,0)
@@ -22,7 +259,24 @@ int main(int argc, char *argv[])
 #endif
 
     try {
+    if(argc > 1 && isHeadlessMode(argv[1]))
+    {
+        QCoreApplication a{argc, argv};
+        return runHeadless(QCoreApplication::arguments());
+    }
+
+    //Before QApplication, it's part of the start
+    for(int i = 1; i < argc; i++)
+        if(strcmp(argv[i], "--startup-times") == 0)
+            StartupTimes::enable();
+
     QApplication a{argc, argv};
+    StartupTimes::mark("application");
+
+    //Needs a display for the GL context (see runRenderBenchmark), but no window is shown
+    if(argc > 1 && strcmp(argv[1], "--render-benchmark") == 0)
+        return runRenderBenchmark(QCoreApplication::arguments());
+
     QCoreApplication::setOrganizationName("FDG AB");
     QCoreApplication::setOrganizationDomain("fdg-ab.de");
     QCoreApplication::setApplicationName("Robot Steve");
@@ -83,6 +337,9 @@ int main(int argc, char *argv[])
 
                 return 0;
             }
+            else if(argument.compare("--startup-times", Qt::CaseInsensitive) == 0)
+                continue; //Already handled
+
             else if(argument.compare("--code", Qt::CaseInsensitive) == 0)
                 state = NEXT_IS_CODE;
 
@@ -99,7 +356,8 @@ int main(int argc, char *argv[])
                 {
                     QFileInfo file_info{argument};
 
-                    if(file_info.completeSuffix().compare("stworld", Qt::CaseInsensitive) == 0)
+                    if(file_info.completeSuffix().compare("stworld", Qt::CaseInsensitive) == 0
+                            || file_info.completeSuffix().compare("stworldb", Qt::CaseInsensitive) == 0)
                         world_file = argument;
 
                     else
@@ -109,30 +367,20 @@ int main(int argc, char *argv[])
         }
     }
 
-    MainWindow w;
-    if(!code_file.isEmpty())
+    if(code_file.startsWith(':') || world_file.startsWith(':'))
     {
-        if(code_file.startsWith(':'))
-        {
-            QMessageBox::critical(nullptr, QObject::trUtf8("Fehler"), QObject::trUtf8("Bitte kein Doppelpunkt an erster Stelle."));
-            return 1;
-        }
-
-        w.loadCodeFile(code_file);
+        QMessageBox::critical(nullptr, QObject::trUtf8("Fehler"), QObject::trUtf8("Bitte kein Doppelpunkt an erster Stelle."));
+        return 1;
     }
 
-    if(!world_file.isEmpty())
-    {
-        if(world_file.startsWith(':'))
-        {
-            QMessageBox::critical(nullptr, QObject::trUtf8("Fehler"), QObject::trUtf8("Bitte kein Doppelpunkt an erster Stelle."));
-            return 1;
-        }
-
-        w.loadWorldFile(world_file);
-    }
+    MainWindow w;
+    StartupTimes::mark("main window");
 
     w.show();
+    StartupTimes::mark("show");
+
+    //Only after the window is there
+    w.loadOnStart(code_file, world_file);
 
     return a.exec();
     }
@@ -10,6 +10,8 @@
 #include "ui_mainwindow.h"
 #include "examplesdialog.h"
 #include "worlddialog.h"
+#include "replaydialog.h"
+#include "startuptimes.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow{parent},
@@ -22,6 +24,8 @@ MainWindow::MainWindow(QWidget *parent) :
     highlighter{&codeEdit, &interpreter},
     save_shortcut(QKeySequence("Ctrl+S"), this)
 {
+    StartupTimes::mark("widgets");
+
     //UI
     ui->setupUi(this);
     codeEdit.setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Expanding);
@@ -76,9 +80,11 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionLoadWorld, SIGNAL(triggered()), this, SLOT(openWorld()));
     connect(ui->actionExamples, SIGNAL(triggered()), this, SLOT(showExamples()));
     connect(ui->actionHideCode, SIGNAL(toggled(bool)), &codeEdit, SLOT(setHidden(bool)));
+    connect(ui->actionProfiling, SIGNAL(toggled(bool)), this, SLOT(setProfiling(bool)));
     connect(ui->actionQuit, SIGNAL(triggered()), this, SLOT(close()));
     connect(ui->actionSettingsWorld, SIGNAL(triggered()), this, SLOT(showWorldSettings()));
     connect(ui->actionResetWorld, SIGNAL(triggered()), this, SLOT(resetWorld()));
+    connect(ui->actionReplay, SIGNAL(triggered()), this, SLOT(openReplay()));
     connect(ui->actionDefaultTexture, SIGNAL(triggered()), this, SLOT(loadDefaultTexture()));
     connect(ui->actionLoadTexture, SIGNAL(triggered()), this, SLOT(loadTexture()));
     connect(ui->actionHelpDialog, SIGNAL(triggered()), this, SLOT(showHelpDialog()));
@@ -145,8 +151,10 @@ void MainWindow::codeStep()
 
 void MainWindow::handleError(SteveInterpreterException &e)
 {
-    std::cerr << e.message().toStdString() << std::endl;
+    std::cerr << e.message().toStdString() << std::endl
+              << e.backtraceText().toStdString();
     showMessage(e.message());
+    status.setToolTip(e.backtraceText());
 
     highlighter.highlight(e.getLine(), error_format, e.getAffected());
 }
@@ -179,6 +187,8 @@ void MainWindow::clockEvent()
         if(speed_ms > 0 || !automatic)
             highlighter.highlight(line, current_line_format);
 
+        //Nobody can follow the lines at full speed anyway
+        interpreter.setFusion(automatic && speed_ms == 0);
         interpreter.executeLine();
 
         //After a breakpoint current line has to be highlighted
@@ -231,16 +241,26 @@ void MainWindow::switchViews(bool which)
     }
 }
 
+void MainWindow::setProfiling(bool enabled)
+{
+    //Only counts from the next start on
+    interpreter.setProfiling(enabled);
+
+    if(!enabled)
+        codeEdit.clearHeatmap();
+}
+
 void MainWindow::textChanged()
 {
     //If user changes the code, the highlighting is no longer valid
     highlighter.resetHighlight();
+    codeEdit.clearHeatmap();
     code_changed = true;
     code_saved = false;
 }
 
 //Wait for interruption or program end
-bool MainWindow::startExecution() throw (SteveInterpreterException)
+bool MainWindow::startExecution()
 {
     if(execution_started)
         return true;
@@ -285,7 +305,11 @@ void MainWindow::stopExecution()
 
     codeEdit.setReadOnly(false);
 
-    showMessage(QApplication::trUtf8("Programm beendet"));
+    const ExecutionStatistics statistics = interpreter.getStatistics();
+    showMessage(QApplication::trUtf8("Programm beendet (%1 Zeilen, %2 Aktionen)").arg(statistics.lines).arg(statistics.actions));
+
+    if(interpreter.isProfiling())
+        codeEdit.setHeatmap(interpreter.getLineHits(), interpreter.getLineActions());
 
     ui->actionSchritt->setDisabled(true);
     ui->actionStarten->setDisabled(true);
@@ -309,7 +333,7 @@ void MainWindow::reset()
     refreshButtons();
 }
 
-void MainWindow::setCode() throw (SteveInterpreterException)
+void MainWindow::setCode()
 {
     showMessage(QApplication::trUtf8("Parsen.."));
 
@@ -373,6 +397,25 @@ void MainWindow::loadWorldFile(QString path)
         QMessageBox::critical(this, trUtf8("Fehler beim Öffnen"), trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(file_info.fileName()));
 }
 
+void MainWindow::loadOnStart(const QString &code_file, const QString &world_file)
+{
+    start_code_file = code_file;
+    start_world_file = world_file;
+
+    QTimer::singleShot(0, this, SLOT(loadStartFiles()));
+}
+
+void MainWindow::loadStartFiles()
+{
+    if(!start_code_file.isEmpty())
+        loadCodeFile(start_code_file);
+
+    if(!start_world_file.isEmpty())
+        loadWorldFile(start_world_file);
+
+    StartupTimes::mark("files");
+}
+
 void MainWindow::loadCodeFile(QString path)
 {
     QFile file{path};
@@ -466,7 +509,7 @@ void MainWindow::openWorld()
 {
     QString filename = QFileDialog::getOpenFileName(this, trUtf8("Welt öffnen"),
                                                     settings.value("lastOpenWorldDir", QDir::homePath()).toString(),
-                                                    trUtf8("Welt (*.stworld);;Alle Dateien (*)"));
+                                                    trUtf8("Welt (*.stworld *.stworldb);;Alle Dateien (*)"));
 
     //Open dialog closed or cancelled
     if(filename.isEmpty())
@@ -481,11 +524,35 @@ void MainWindow::openWorld()
     refreshButtons();
 }
 
+//Recorded with --batch --trace
+void MainWindow::openReplay()
+{
+    QString filename = QFileDialog::getOpenFileName(this, trUtf8("Aufzeichnung öffnen"),
+                                                    settings.value("lastOpenWorldDir", QDir::homePath()).toString(),
+                                                    trUtf8("Aufzeichnung (*.sttrace);;Alle Dateien (*)"));
+
+    if(filename.isEmpty())
+        return;
+
+    settings.setValue("lastOpenWorldDir", QFileInfo(filename).absolutePath());
+
+    ReplayDialog *dialog = new ReplayDialog{this};
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    if(!dialog->loadFile(filename))
+    {
+        delete dialog;
+        QMessageBox::critical(this, trUtf8("Fehler beim Öffnen"), trUtf8("Die Datei '%1' konnte nicht geöffnet werden!").arg(QFileInfo(filename).fileName()));
+        return;
+    }
+
+    dialog->show();
+}
+
 void MainWindow::saveWorld()
 {
     QString filename = QFileDialog::getSaveFileName(this, trUtf8("Welt speichern"),
                                                     settings.value("lastOpenWorldDir", QDir::homePath()).toString(),
-                                                    trUtf8("Welt (*.stworld);;Alle Dateien (*)"));
+                                                    trUtf8("Welt (*.stworld);;Binäre Welt (*.stworldb);;Alle Dateien (*)"));
 
      if(filename.isEmpty())
          return;
@@ -494,7 +561,13 @@ void MainWindow::saveWorld()
 
      settings.setValue("lastOpenWorldDir", file_info.absolutePath());
 
-     if(!world.saveFile(filename))
+     bool saved;
+     if(file_info.suffix().compare("stworldb", Qt::CaseInsensitive) == 0)
+         saved = world.saveBinaryFile(filename);
+     else
+         saved = world.saveFile(filename);
+
+     if(!saved)
          QMessageBox::critical(this, trUtf8("Fehler beim Speichern"), trUtf8("Die Datei '%1' konnte nicht gespeichert werden!").arg(file_info.fileName()));
 }
 
@@ -568,6 +641,7 @@ void MainWindow::loadTexture()
 void MainWindow::showMessage(const QString &msg)
 {
     status.setText(msg);
+    status.setToolTip({});
 }
 
 void MainWindow::closeEvent(QCloseEvent *e)
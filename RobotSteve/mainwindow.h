@@ -49,6 +49,7 @@ public slots:
     void saveWorld();
     void showWorldSettings();
     void resetWorld();
+    void openReplay();
 
     //Menu "Player"
     void loadTexture();
@@ -70,24 +71,31 @@ public slots:
 
     //Other stuff
     void switchViews(bool which);
+    void setProfiling(bool enabled);
     void textChanged();
     void refreshButtons();
     void loadExample(QString name, QString filename);
     void loadWorldFile(QString path);
     void loadCodeFile(QString path);
+    //The files from the command line, loaded as soon as the event loop runs
+    void loadOnStart(const QString &code_file, const QString &world_file);
 
 protected:
     void closeEvent(QCloseEvent *e);
+
+private slots:
+    void loadStartFiles();
     
 private:
     void handleError(SteveInterpreterException &e);
-    bool startExecution() throw (SteveInterpreterException);
-    void setCode() throw (SteveInterpreterException);
+    bool startExecution();
+    void setCode();
     void showMessage(const QString &msg);
 
     float speed_ms;
     bool automatic = false, code_changed = true, code_saved = true;
     QString save_file_name;
+    QString start_code_file, start_world_file;
     QTimer clock;
     bool execution_started = false;
     Ui::MainWindow *ui;
@@ -0,0 +1,230 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <QElapsedTimer>
+#include <QGLFramebufferObject>
+
+#include "renderbenchmark.h"
+#include "steveinterpreter.h"
+
+#ifndef M_PI
+#define M_PI		3.14159265358979323846
+#endif
+
+//GL_ARB_timer_query, not in every gl.h
+#define BENCHMARK_GL_TIME_ELAPSED 0x88BF
+#define BENCHMARK_GL_QUERY_RESULT 0x8866
+
+typedef void (*GenQueriesPtr)(GLsizei n, GLuint *ids);
+typedef void (*DeleteQueriesPtr)(GLsizei n, const GLuint *ids);
+typedef void (*BeginQueryPtr)(GLenum target, GLuint id);
+typedef void (*EndQueryPtr)(GLenum target);
+typedef void (*GetQueryObjectui64vPtr)(GLuint id, GLenum pname, quint64 *params);
+
+void RenderBenchmark::fillWorstCase(World &world, unsigned int max_height)
+{
+    world.resize(world.maximum_size.first, world.maximum_size.second);
+    world.setMaxHeight(max_height);
+
+    for(unsigned int x = 0; x < world.getSize().first; x++)
+        for(unsigned int y = 0; y < world.getSize().second; y++)
+        {
+            WorldObject &object = world.getObject({x, y});
+            object.has_cube = false;
+            object.has_mark = (x + y) % 2 == 0;
+            object.stack_size = max_height;
+        }
+
+    world.rehash();
+}
+
+bool RenderBenchmark::run(QTextStream &out)
+{
+    //Native window for the context, it's never shown
+    world.winId();
+    if(!QGLFormat::hasOpenGL() || !world.isValid())
+    {
+        std::cerr << QObject::trUtf8("Kein OpenGL-Kontext, der Benchmark braucht ein Display mit OpenGL.").toStdString() << std::endl;
+        return false;
+    }
+
+    world.makeCurrent();
+
+    QGLFramebufferObject target{width, height, QGLFramebufferObject::Depth};
+    if(!QGLFramebufferObject::hasOpenGLFramebufferObjects() || !target.isValid())
+    {
+        std::cerr << QObject::trUtf8("Framebuffer Objects werden nicht unterstützt.").toStdString() << std::endl;
+        return false;
+    }
+
+    //Jump instead of animating
+    world.setSpeed(0);
+
+    SteveInterpreter interpreter{&world};
+    bool program_running = !code.isEmpty();
+    if(program_running)
+    {
+        try {
+            interpreter.setCode(code);
+        }
+        catch (SteveInterpreterException &e)
+        {
+            program_error = e.message().replace("\n", " ");
+            program_running = false;
+        }
+    }
+
+    const char *extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    const QGLContext *context = world.context();
+    GenQueriesPtr genQueries = nullptr;
+    DeleteQueriesPtr deleteQueries = nullptr;
+    BeginQueryPtr beginQuery = nullptr;
+    EndQueryPtr endQuery = nullptr;
+    GetQueryObjectui64vPtr getQueryObjectui64v = nullptr;
+    if(extensions && strstr(extensions, "GL_ARB_timer_query"))
+    {
+        genQueries = reinterpret_cast<GenQueriesPtr>(context->getProcAddress("glGenQueries"));
+        deleteQueries = reinterpret_cast<DeleteQueriesPtr>(context->getProcAddress("glDeleteQueries"));
+        beginQuery = reinterpret_cast<BeginQueryPtr>(context->getProcAddress("glBeginQuery"));
+        endQuery = reinterpret_cast<EndQueryPtr>(context->getProcAddress("glEndQuery"));
+        getQueryObjectui64v = reinterpret_cast<GetQueryObjectui64vPtr>(context->getProcAddress("glGetQueryObjectui64v"));
+    }
+    const bool timer_query = genQueries && deleteQueries && beginQuery && endQuery && getQueryObjectui64v;
+
+    GLuint query = 0;
+    if(timer_query)
+        genQueries(1, &query);
+
+    world.initializeGL();
+    target.bind();
+    world.resizeGL(width, height);
+
+    statistics.clear();
+    statistics.reserve(frames);
+    executed_lines = 0;
+
+    QElapsedTimer timer;
+    for(int frame = 0; frame < frames; frame++)
+    {
+        //One orbit, swinging up and down and zooming in and out
+        double progress = static_cast<double>(frame) / frames;
+        world.camera_rotY = 360 * progress;
+        world.camera_rotX = -30 + 15 * sin(progress * 4 * M_PI);
+        world.camera_dist = 8 + 20 * (0.5 - 0.5 * cos(progress * 2 * M_PI));
+        world.updateCamera();
+
+        if(program_running)
+        {
+            try {
+                interpreter.executeLine();
+                executed_lines++;
+                program_running = !interpreter.executionFinished();
+            }
+            catch (SteveInterpreterException &e)
+            {
+                program_error = e.message().replace("\n", " ");
+                program_running = false;
+            }
+        }
+
+        RenderFrameStatistics frame_statistics;
+        quint64 draw_calls = GLDrawable::draw_calls;
+
+        timer.start();
+        if(timer_query)
+            beginQuery(BENCHMARK_GL_TIME_ELAPSED, query);
+
+        if(picking)
+        {
+            glClearColor(1, 1, 1, 1);
+            world.renderScene(true);
+            world.click_image = target.toImage();
+        }
+
+        world.qglClearColor(Qt::white);
+        world.renderScene(false);
+
+        if(timer_query)
+            endQuery(BENCHMARK_GL_TIME_ELAPSED);
+
+        frame_statistics.cpu_ns = timer.nsecsElapsed();
+        glFinish();
+        frame_statistics.frame_ns = timer.nsecsElapsed();
+        frame_statistics.draw_calls = GLDrawable::draw_calls - draw_calls;
+
+        frame_statistics.gpu_ns = -1;
+        if(timer_query)
+        {
+            quint64 gpu_ns = 0;
+            getQueryObjectui64v(query, BENCHMARK_GL_QUERY_RESULT, &gpu_ns);
+            frame_statistics.gpu_ns = gpu_ns;
+        }
+
+        statistics.append(frame_statistics);
+    }
+
+    target.release();
+    if(timer_query)
+        deleteQueries(1, &query);
+
+    //Stable order of keys, like the microbenchmarks
+    QVector<qint64> cpu, frame, gpu, draw_calls;
+    for(const RenderFrameStatistics &s : statistics)
+    {
+        cpu.append(s.cpu_ns);
+        frame.append(s.frame_ns);
+        gpu.append(s.gpu_ns);
+        draw_calls.append(s.draw_calls);
+    }
+
+    out << "{\n"
+        << "  \"renderer\": \"" << reinterpret_cast<const char*>(glGetString(GL_RENDERER)) << "\",\n"
+        << "  \"width\": " << width << ",\n"
+        << "  \"height\": " << height << ",\n"
+        << "  \"world\": \"" << world.getSize().first << "x" << world.getSize().second << "\",\n"
+        << "  \"frames\": " << statistics.size() << ",\n"
+        << "  \"picking\": " << (picking ? "true" : "false") << ",\n"
+        << "  \"executed_lines\": " << executed_lines << ",\n"
+        << "  \"program_error\": \"" << QString(program_error).replace("\\", "\\\\").replace("\"", "\\\"") << "\",\n";
+
+    printStatistics(out, "cpu_ns", cpu);
+    out << ",\n";
+    printStatistics(out, "frame_ns", frame);
+    out << ",\n";
+    if(timer_query)
+        printStatistics(out, "gpu_ns", gpu);
+    else
+        out << "  \"gpu_ns\": null";
+    out << ",\n";
+    printStatistics(out, "draw_calls", draw_calls);
+    out << "\n}\n";
+
+    out.flush();
+
+    return true;
+}
+
+void RenderBenchmark::printStatistics(QTextStream &out, const QString &name, QVector<qint64> values)
+{
+    if(values.isEmpty())
+    {
+        out << "  \"" << name << "\": null";
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    qint64 sum = 0;
+    for(qint64 value : values)
+        sum += value;
+
+    auto percentile = [&] (int p) { return values[std::min(values.size() - 1, values.size() * p / 100)]; };
+
+    out << "  \"" << name << "\": {"
+        << "\"mean\": " << sum / values.size() << ", "
+        << "\"p50\": " << percentile(50) << ", "
+        << "\"p90\": " << percentile(90) << ", "
+        << "\"p99\": " << percentile(99) << ", "
+        << "\"max\": " << values.last() << "}";
+}
@@ -0,0 +1,50 @@
+#ifndef RENDERBENCHMARK_H
+#define RENDERBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QTextStream>
+
+#include "glworld.h"
+
+struct RenderFrameStatistics {
+    qint64 cpu_ns; //Until all GL calls are submitted
+    qint64 frame_ns; //Until the GPU is done (glFinish)
+    qint64 gpu_ns; //GL_TIME_ELAPSED, -1 if timer queries aren't supported
+    quint64 draw_calls;
+};
+
+//Renders a world offscreen (into a FBO of a hidden GLWorld) while the camera orbits around it.
+//The GLWorld still needs a display for its context, run() fails without one.
+//and optionally a program runs, one line per frame.
+//Prints the frame time percentiles as JSON.
+class RenderBenchmark
+{
+public:
+    RenderBenchmark(GLWorld &world) : world(world) {}
+
+    void setFrames(int frames) { this->frames = frames; }
+    void setSize(int width, int height) { this->width = width; this->height = height; }
+    void setCode(const QStringList &code) { this->code = code; }
+    void setPicking(bool picking) { this->picking = picking; } //Also render and read back the color picking image every frame
+    bool run(QTextStream &out);
+
+    //25x25 and every field stacked up to max_height, the worst case
+    static void fillWorstCase(World &world, unsigned int max_height);
+
+private:
+    void printStatistics(QTextStream &out, const QString &name, QVector<qint64> values);
+
+    GLWorld &world;
+    int frames = 600;
+    int width = 800, height = 600;
+    QStringList code;
+    bool picking = false;
+
+    QVector<RenderFrameStatistics> statistics;
+    quint64 executed_lines = 0;
+    QString program_error;
+};
+
+#endif // RENDERBENCHMARK_H
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <climits>
+#include <QFileInfo>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+
+#include "replaydialog.h"
+
+//Below this, every step is animated like in normal execution
+static const int animated_steps_per_second = 10;
+
+ReplayDialog::ReplayDialog(QWidget *parent) :
+    QDialog{parent},
+    world{5, 5, 5, this},
+    timeline{Qt::Horizontal, this},
+    play_button{trUtf8("Abspielen"), this},
+    speed{this},
+    position{this}
+{
+    setWindowTitle(trUtf8("Aufzeichnung"));
+    resize(640, 560);
+
+    world.setEditable(false);
+
+    speed.setRange(1, 1000000);
+    speed.setValue(2);
+    speed.setSuffix(trUtf8(" Schritte/s"));
+
+    QHBoxLayout *controls = new QHBoxLayout;
+    controls->addWidget(&play_button);
+    controls->addWidget(&timeline, 1);
+    controls->addWidget(&speed);
+
+    QVBoxLayout *layout = new QVBoxLayout{this};
+    layout->addWidget(&world, 1);
+    layout->addLayout(controls);
+    layout->addWidget(&position);
+
+    //Frame rate of the GLWorld, more steps per frame aren't visible anyway
+    clock.setInterval(1000/30);
+
+    connect(&play_button, SIGNAL(clicked()), this, SLOT(play()));
+    connect(&timeline, SIGNAL(valueChanged(int)), this, SLOT(seekToPosition(int)));
+    connect(&clock, SIGNAL(timeout()), this, SLOT(clockEvent()));
+}
+
+bool ReplayDialog::loadFile(const QString &filename)
+{
+    pause();
+
+    if(!trace.loadFile(filename) || !trace.seek(0, world))
+        return false;
+
+    setWindowTitle(trUtf8("Aufzeichnung - %1").arg(QFileInfo(filename).fileName()));
+    timeline.setRange(0, timelinePosition(trace.getStepCount()));
+    timeline.setValue(0);
+    showStep(ANIM_STANDING);
+
+    return true;
+}
+
+void ReplayDialog::play()
+{
+    if(clock.isActive())
+    {
+        pause();
+        return;
+    }
+
+    if(trace.getStep() >= trace.getStepCount())
+        seekToStep(0);
+
+    play_start_step = trace.getStep();
+    play_timer.start();
+    clock.start();
+    play_button.setText(trUtf8("Anhalten"));
+}
+
+void ReplayDialog::pause()
+{
+    clock.stop();
+    play_button.setText(trUtf8("Abspielen"));
+}
+
+int ReplayDialog::timelinePosition(quint64 step) const
+{
+    const quint64 steps = trace.getStepCount();
+    if(steps <= INT_MAX)
+        return static_cast<int>(step);
+
+    return static_cast<int>(static_cast<double>(step) / steps * INT_MAX + 0.5);
+}
+
+quint64 ReplayDialog::timelineStep(int position) const
+{
+    const quint64 steps = trace.getStepCount();
+    if(steps <= INT_MAX)
+        return position;
+    if(position >= INT_MAX)
+        return steps; //Also avoids rounding past the end
+
+    return static_cast<quint64>(static_cast<double>(position) / INT_MAX * steps + 0.5);
+}
+
+void ReplayDialog::seekToPosition(int position)
+{
+    //Scaled, so only move if it's really somewhere else
+    if(position != timelinePosition(trace.getStep()))
+        seekToStep(timelineStep(position));
+}
+
+//Scrubbing: Restore the nearest checkpoint and replay from there, at most one checkpoint interval
+void ReplayDialog::seekToStep(quint64 step)
+{
+    if(step == trace.getStep())
+        return;
+
+    if(!trace.seek(step, world))
+    {
+        pause();
+        return;
+    }
+
+    if(clock.isActive())
+    {
+        play_start_step = trace.getStep();
+        play_timer.start();
+    }
+
+    showStep(ANIM_STANDING);
+}
+
+//Catches up with the time since play() instead of counting timer events, which can be late
+void ReplayDialog::clockEvent()
+{
+    const quint64 target = std::min(trace.getStepCount(), play_start_step + static_cast<quint64>(play_timer.elapsed()) * speed.value() / 1000);
+
+    if(target > trace.getStep() + trace.getCheckpointInterval())
+        seekToStep(target);
+    else if(target > trace.getStep())
+    {
+        const Coords steve{world.getX(), world.getY()};
+        const ORIENTATION orientation = world.getOrientation();
+        const quint64 hash = world.getHash();
+
+        while(trace.getStep() < target)
+        {
+            if(!trace.next(world))
+            {
+                pause();
+                break;
+            }
+        }
+
+        //Animations only make sense for single steps
+        ANIMATION animation = ANIM_STANDING;
+        if(speed.value() <= animated_steps_per_second && target == trace.getStep() && hash != world.getHash())
+        {
+            world.setSpeed(1000 / speed.value());
+            if(steve != Coords(world.getX(), world.getY()))
+                animation = ANIM_STEP;
+            else if(orientation != world.getOrientation())
+                animation = ANIM_TURN;
+            else
+                animation = ANIM_BEND;
+        }
+
+        showStep(animation);
+    }
+
+    if(trace.getStep() >= trace.getStepCount())
+        pause();
+}
+
+void ReplayDialog::showStep(ANIMATION animation)
+{
+    world.replayed(animation);
+
+    timeline.blockSignals(true);
+    timeline.setValue(timelinePosition(trace.getStep()));
+    timeline.blockSignals(false);
+
+    position.setText(trUtf8("Schritt %1 von %2, nächste Zeile %3").arg(trace.getStep()).arg(trace.getStepCount()).arg(trace.getLine() + 1));
+}
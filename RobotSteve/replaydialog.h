@@ -0,0 +1,50 @@
+#ifndef REPLAYDIALOG_H
+#define REPLAYDIALOG_H
+
+#include <QDialog>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSlider>
+#include <QSpinBox>
+#include <QPushButton>
+#include <QLabel>
+
+#include "glworld.h"
+#include "worldtrace.h"
+
+//Plays a recorded run (.sttrace) without executing the program.
+//Fast playback only shows the latest step every frame, jumps restore the nearest checkpoint.
+class ReplayDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ReplayDialog(QWidget *parent = 0);
+
+    bool loadFile(const QString &filename);
+
+public slots:
+    void play();
+    void pause();
+    void seekToPosition(int position); //Of the timeline
+    void clockEvent();
+
+private:
+    void seekToStep(quint64 step);
+    void showStep(ANIMATION animation);
+    //The timeline is an int, long traces are scaled down to fit
+    int timelinePosition(quint64 step) const;
+    quint64 timelineStep(int position) const;
+
+    TraceReader trace;
+    GLWorld world;
+    QSlider timeline;
+    QPushButton play_button;
+    QSpinBox speed; //Steps per second
+    QLabel position;
+    QTimer clock;
+    QElapsedTimer play_timer;
+    quint64 play_start_step = 0;
+};
+
+#endif // REPLAYDIALOG_H
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <QElapsedTimer>
+#include <QString>
+
+#include "startuptimes.h"
+
+static bool enabled = false;
+static QElapsedTimer timer;
+static double last_mark = 0;
+
+void StartupTimes::enable()
+{
+    enabled = true;
+    timer.start();
+}
+
+double StartupTimes::now()
+{
+    return enabled ? timer.nsecsElapsed() / 1e6 : 0;
+}
+
+void StartupTimes::mark(const char *phase)
+{
+    if(!enabled)
+        return;
+
+    report(phase, last_mark);
+    last_mark = now();
+}
+
+void StartupTimes::report(const char *phase, double start)
+{
+    if(!enabled)
+        return;
+
+    const double end = now();
+    std::cerr << phase << '\t' << QString::number(end, 'f', 1).toStdString() << '\t' << QString::number(end - start, 'f', 1).toStdString() << std::endl;
+}
@@ -0,0 +1,19 @@
+#ifndef STARTUPTIMES_H
+#define STARTUPTIMES_H
+
+//How long the phases of the start take, printed to stderr with --startup-times.
+//One line per phase: name, milliseconds since the start, milliseconds the phase took
+class StartupTimes
+{
+public:
+    static void enable();
+
+    //Milliseconds since enable()
+    static double now();
+    //Ends the phase which started with the previous mark()
+    static void mark(const char *phase);
+    //A phase which doesn't follow the previous one, e.g. something loaded on first use
+    static void report(const char *phase, double start);
+};
+
+#endif // STARTUPTIMES_H
@@ -9,19 +9,88 @@
 #include <QTextBlock>
 #include <QAbstractItemView>
 #include <QStringListModel>
+#include <QPainter>
+#include <QAbstractTextDocumentLayout>
+#include <QHelpEvent>
+#include <QPaintEvent>
+#include <cmath>
+#include <algorithm>
 
 #include "steveedit.h"
 #include "steveinterpreter.h"
 
 SteveEdit::SteveEdit(SteveHelp *help, QWidget *parent) :
-    QTextEdit(parent), help{help}, completer{help->getWordList()}
+    QTextEdit(parent), help{help}, completions{std::make_shared<CompletionIndex>()}, completer{&completion_model}, heatmap{this}
 {
+    for(const QString &word : help->getWordList())
+        completions->insert(word);
+
+    heatmap.hide();
     completer.setCaseSensitivity(Qt::CaseInsensitive);
     completer.setWrapAround(false);
     completer.setWidget(this);
-    completer.setCompletionMode(QCompleter::PopupCompletion);
+    //completion_model already only contains the matches
+    completer.setCompletionMode(QCompleter::UnfilteredPopupCompletion);
 
     connect(&completer, SIGNAL(activated(QString)), this, SLOT(insertCompletion(QString)));
+    connect(document(), SIGNAL(contentsChange(int,int,int)), this, SLOT(updateSymbols(int,int,int)));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateHeatmap()));
+}
+
+void SteveEdit::setHeatmap(const QVector<quint64> &hits, const QVector<quint64> &actions)
+{
+    this->hits = hits;
+    this->actions = actions;
+
+    max_hits = 0;
+    for(quint64 h : hits)
+        max_hits = std::max(max_hits, h);
+
+    heatmap.show();
+    updateHeatmap();
+}
+
+void SteveEdit::clearHeatmap()
+{
+    if(!hasHeatmap())
+        return;
+
+    hits.clear();
+    actions.clear();
+    max_hits = 0;
+
+    heatmap.hide();
+    updateHeatmap();
+}
+
+int SteveEdit::heatmapWidth() const
+{
+    if(!hasHeatmap())
+        return 0;
+
+    return fontMetrics().width(QString::number(max_hits)) + 8;
+}
+
+int SteveEdit::lineAt(int y) const
+{
+    return cursorForPosition({0, y}).blockNumber();
+}
+
+void SteveEdit::updateHeatmap()
+{
+    setViewportMargins(heatmapWidth(), 0, 0, 0);
+
+    QRect cr = contentsRect();
+    heatmap.setGeometry(cr.left(), cr.top(), heatmapWidth(), cr.height());
+    heatmap.update();
+}
+
+void SteveEdit::resizeEvent(QResizeEvent *e)
+{
+    QTextEdit::resizeEvent(e);
+
+    if(hasHeatmap())
+        updateHeatmap();
 }
 
 void SteveEdit::insertCompletion(const QString& completion)
@@ -35,6 +104,61 @@ void SteveEdit::insertCompletion(const QString& completion)
     setTextCursor(cursor);
 }
 
+CompletionSymbol::CompletionSymbol(const std::shared_ptr<CompletionIndex> &index, const QString &name) :
+    index{index}, name{name}
+{
+    index->insert(name);
+}
+
+CompletionSymbol::~CompletionSymbol()
+{
+    index->remove(name);
+}
+
+//The name if line defines a custom instruction or condition, checked like in SteveInterpreter::setCode
+QString SteveEdit::definedSymbol(const QString &line)
+{
+    const QStringList words = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+    if(words.size() != 2)
+        return QString();
+
+    const SteveInterpreter::KEYWORD keyword = SteveInterpreter::getKeyword(words[0]);
+    if(keyword != SteveInterpreter::KEYWORD_NEW_INSTR && keyword != SteveInterpreter::KEYWORD_NEW_COND)
+        return QString();
+
+    const QString &name = words[1];
+    if(!QRegExp("^(\\w|\\d)+$").exactMatch(name) || SteveInterpreter::getKeyword(name) != SteveInterpreter::KEYWORD_INVALID
+            || SteveInterpreter::getInstruction(name) != SteveInterpreter::INSTR_INVALID || SteveInterpreter::getCondition(name) != SteveInterpreter::COND_INVALID)
+        return QString();
+
+    return name;
+}
+
+//Only the changed blocks are looked at. Deleted blocks take their CompletionSymbol with them.
+void SteveEdit::updateSymbols(int position, int removed, int added)
+{
+    Q_UNUSED(removed);
+
+    QTextBlock end = document()->findBlock(position + added);
+    if(end.isValid())
+        end = end.next();
+
+    for(QTextBlock block = document()->findBlock(position); block.isValid() && block != end; block = block.next())
+    {
+        const QString name = definedSymbol(block.text());
+        SteveBlockData *data = static_cast<SteveBlockData*>(block.userData());
+        CompletionSymbol *symbol = dynamic_cast<CompletionSymbol*>(data);
+
+        if(symbol ? symbol->getName() == name : name.isEmpty())
+            continue;
+
+        //Keeps the highlighter's flag, deletes the old one
+        SteveBlockData *replacement = name.isEmpty() ? new SteveBlockData : new CompletionSymbol(completions, name);
+        replacement->pending = data && data->pending;
+        block.setUserData(replacement);
+    }
+}
+
 //QTextCursor.select(WORD_UNDER_CURSOR) also sees "*" as seperator.
 //This function only respects QChar::isSpace
 QString SteveEdit::currentWord()
@@ -94,19 +218,85 @@ void SteveEdit::keyPressEvent(QKeyEvent *e)
             return;
 
         QString current_word = currentWord();
-        if(current_word.length() == 0)
+        const QStringList matches = current_word.isEmpty() ? QStringList() : completions->complete(current_word);
+        if(matches.isEmpty())
         {
             completer.popup()->close();
             return;
         }
 
+        //The popup stays open and only its list changes while typing
         completer.setCompletionPrefix(current_word);
+        completion_model.setStringList(matches);
         completer.popup()->setCurrentIndex(completer.completionModel()->index(0, 0));
-        completer.popup()->show();
 
-        QRect cr = cursorRect();
-        cr.setWidth(completer.popup()->sizeHintForColumn(0)
-                    + completer.popup()->verticalScrollBar()->sizeHint().width());
-        completer.complete(cr);
+        if(!completer.popup()->isVisible())
+        {
+            QRect cr = cursorRect();
+            cr.setWidth(completer.popup()->sizeHintForColumn(0)
+                        + completer.popup()->verticalScrollBar()->sizeHint().width());
+            completer.complete(cr);
+        }
+    }
+}
+
+SteveEditHeatmap::SteveEditHeatmap(SteveEdit *editor) :
+    QWidget(editor), editor{editor}
+{}
+
+QSize SteveEditHeatmap::sizeHint() const
+{
+    return {editor->heatmapWidth(), 0};
+}
+
+void SteveEditHeatmap::paintEvent(QPaintEvent *e)
+{
+    QPainter painter{this};
+    painter.fillRect(e->rect(), palette().color(QPalette::Window));
+
+    if(editor->max_hits == 0)
+        return;
+
+    const double log_max = std::log(static_cast<double>(editor->max_hits) + 1);
+    const int scroll = editor->verticalScrollBar()->value();
+    QAbstractTextDocumentLayout *layout = editor->document()->documentLayout();
+
+    //Only the visible lines
+    for(QTextBlock block = editor->cursorForPosition({0, 0}).block(); block.isValid(); block = block.next())
+    {
+        QRectF rect = layout->blockBoundingRect(block).translated(0, -scroll);
+        if(rect.top() > height())
+            break;
+
+        int line = block.blockNumber();
+        if(line >= editor->hits.size() || editor->hits[line] == 0)
+            continue;
+
+        //Logarithmic, otherwise loops make everything else invisible
+        double heat = std::log(static_cast<double>(editor->hits[line]) + 1) / log_max;
+        QRect line_rect{0, static_cast<int>(rect.top()), width(), static_cast<int>(rect.height())};
+
+        painter.fillRect(line_rect, QColor::fromHsv(60 - static_cast<int>(60 * heat), 64 + static_cast<int>(191 * heat), 255));
+        painter.setPen(Qt::black);
+        painter.drawText(line_rect.adjusted(0, 0, -4, 0), Qt::AlignRight | Qt::AlignVCenter, QString::number(editor->hits[line]));
     }
 }
+
+bool SteveEditHeatmap::event(QEvent *e)
+{
+    if(e->type() == QEvent::ToolTip)
+    {
+        QHelpEvent *help_event = static_cast<QHelpEvent*>(e);
+        int line = editor->lineAt(help_event->pos().y());
+
+        if(line >= 0 && line < editor->hits.size())
+            QToolTip::showText(help_event->globalPos(), QObject::trUtf8("Zeile %1: %2 mal ausgeführt, %3 Aktionen")
+                               .arg(line + 1).arg(editor->hits[line]).arg(line < editor->actions.size() ? editor->actions[line] : 0), this);
+        else
+            QToolTip::hideText();
+
+        return true;
+    }
+
+    return QWidget::event(e);
+}
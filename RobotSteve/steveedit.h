@@ -3,29 +3,85 @@
 
 #include <QTextEdit>
 #include <QCompleter>
+#include <QStringListModel>
+#include <QVector>
+#include <memory>
 
 #include "steveinterpreter.h"
 #include "stevehelp.h"
+#include "completionindex.h"
+#include "stevehighlighter.h"
+
+class SteveEdit;
+
+//Gutter left of the code, shows how often each line has been executed
+class SteveEditHeatmap : public QWidget
+{
+public:
+    SteveEditHeatmap(SteveEdit *editor);
+
+    QSize sizeHint() const;
+
+protected:
+    void paintEvent(QPaintEvent *e);
+    bool event(QEvent *e);
+
+private:
+    SteveEdit *editor;
+};
+
+//Attached to a block with an anweisung or bedingung line, keeps its name in the completion index while the block exists.
+//Shares the index because the document deletes its blocks after SteveEdit is gone.
+class CompletionSymbol : public SteveBlockData
+{
+public:
+    CompletionSymbol(const std::shared_ptr<CompletionIndex> &index, const QString &name);
+    ~CompletionSymbol();
+
+    const QString &getName() const { return name; }
+
+private:
+    std::shared_ptr<CompletionIndex> index;
+    QString name;
+};
 
 class SteveEdit : public QTextEdit
 {
     Q_OBJECT
 
+    friend class SteveEditHeatmap;
+
 public:
     explicit SteveEdit(SteveHelp *help, QWidget *parent = 0);
 
+    //Both indexed by line, as returned by SteveInterpreter::getLineHits and getLineActions
+    void setHeatmap(const QVector<quint64> &hits, const QVector<quint64> &actions);
+    void clearHeatmap();
+    bool hasHeatmap() const { return !hits.isEmpty(); }
+
 protected:
     void keyPressEvent(QKeyEvent *e);
+    void resizeEvent(QResizeEvent *e);
 
 private slots:
     void insertCompletion(const QString& completion);
+    void updateSymbols(int position, int removed, int added);
+    void updateHeatmap();
 
 private:
     QString currentWord();
+    static QString definedSymbol(const QString &line);
+    int heatmapWidth() const;
+    int lineAt(int y) const;
 
     SteveHelp *help;
+    std::shared_ptr<CompletionIndex> completions; //Built-in words and the custom instructions and conditions in the code
+    QStringListModel completion_model; //Only the matches for the current word
     QCompleter completer;
 
+    SteveEditHeatmap heatmap;
+    QVector<quint64> hits, actions;
+    quint64 max_hits = 0;
 };
 
 #endif // STEVEEDIT_H
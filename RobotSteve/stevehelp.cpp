@@ -6,17 +6,50 @@
 
 #include "stevehelp.h"
 #include "helpdialog.h"
+#include "startuptimes.h"
 
 SteveHelp::SteveHelp(SteveInterpreter *interpreter)
     : interpreter{interpreter}
 {
+    fillWordList();
 }
 
 SteveHelp::SteveHelp(SteveInterpreter *interpreter, QString path)
-    : interpreter{interpreter}
+    : interpreter{interpreter}, path{path}
+{
+    fillWordList();
+}
+
+//The words don't depend on the help file
+void SteveHelp::fillWordList()
 {
-    if(!loadFile(path))
+    QMetaEnum keyword_meta = SteveInterpreter::staticMetaObject.enumerator(SteveInterpreter::staticMetaObject.indexOfEnumerator("KEYWORD"));
+    QMetaEnum instruction_meta = SteveInterpreter::staticMetaObject.enumerator(SteveInterpreter::staticMetaObject.indexOfEnumerator("INSTRUCTION"));
+    QMetaEnum condition_meta = SteveInterpreter::staticMetaObject.enumerator(SteveInterpreter::staticMetaObject.indexOfEnumerator("CONDITION"));
+
+    int i;
+    for(i = 0; i < keyword_meta.keyCount(); i++)
+        word_list << SteveInterpreter::str(static_cast<SteveInterpreter::KEYWORD>(keyword_meta.value(i)));
+    for(i = 0; i < instruction_meta.keyCount(); i++)
+        word_list << SteveInterpreter::str(static_cast<SteveInterpreter::INSTRUCTION>(instruction_meta.value(i)));
+    for(i = 0; i < condition_meta.keyCount(); i++)
+        word_list << SteveInterpreter::str(static_cast<SteveInterpreter::CONDITION>(condition_meta.value(i)));
+}
+
+void SteveHelp::ensureLoaded()
+{
+    if(loaded || path.isEmpty())
+        return;
+
+    const double start = StartupTimes::now();
+    loaded = loadFile(path);
+    StartupTimes::report("help", start);
+
+    if(!loaded)
+    {
         QMessageBox::critical(nullptr, QObject::trUtf8("Fehler beim Laden"), QObject::trUtf8("Die Hilfe konnte nicht geladen werden."));
+        loaded = true; //Don't try again
+    }
 }
 
 //Parse the .xml file containing the help texts
@@ -98,20 +131,15 @@ bool SteveHelp::loadFile(QString path)
         }
     }
 
-    //Fill word_list
-    int i;
-    for(i = 0; i < keyword_meta.keyCount(); i++)
-        word_list << interpreter->str(static_cast<SteveInterpreter::KEYWORD>(keyword_meta.value(i)));
-    for(i = 0; i < instruction_meta.keyCount(); i++)
-        word_list << interpreter->str(static_cast<SteveInterpreter::INSTRUCTION>(instruction_meta.value(i)));
-    for(i = 0; i < condition_meta.keyCount(); i++)
-        word_list << interpreter->str(static_cast<SteveInterpreter::CONDITION>(condition_meta.value(i)));
+    loaded = true;
 
     return true;
 }
 
 QString SteveHelp::getHelp(SteveInterpreter::KEYWORD keyword)
 {
+    ensureLoaded();
+
     if(!keyword_help.contains(keyword))
         return QObject::trUtf8("Keine Hilfe für das Wort verfügbar.");
 
@@ -120,6 +148,8 @@ QString SteveHelp::getHelp(SteveInterpreter::KEYWORD keyword)
 
 QString SteveHelp::getHelp(SteveInterpreter::INSTRUCTION instruction)
 {
+    ensureLoaded();
+
     if(!instruction_help.contains(instruction))
         return QObject::trUtf8("Keine Hilfe für die Anweisung verfügbar.");
 
@@ -128,6 +158,8 @@ QString SteveHelp::getHelp(SteveInterpreter::INSTRUCTION instruction)
 
 QString SteveHelp::getHelp(SteveInterpreter::CONDITION condition)
 {
+    ensureLoaded();
+
     if(!condition_help.contains(condition))
         return QObject::trUtf8("Keine Hilfe für die Bedingung verfügbar.");
 
@@ -137,9 +169,11 @@ QString SteveHelp::getHelp(SteveInterpreter::CONDITION condition)
 //Get the help text for a specific keyword, condition or instruction
 QString SteveHelp::getHelp(QString word)
 {
-    SteveInterpreter::KEYWORD keyword = interpreter->getKeyword(word);
-    SteveInterpreter::INSTRUCTION instruction = interpreter->getInstruction(word);
-    SteveInterpreter::CONDITION condition = interpreter->getCondition(word);
+    ensureLoaded();
+
+    SteveInterpreter::KEYWORD keyword = SteveInterpreter::getKeyword(word);
+    SteveInterpreter::INSTRUCTION instruction = SteveInterpreter::getInstruction(word);
+    SteveInterpreter::CONDITION condition = SteveInterpreter::getCondition(word);
 
     if(keyword != SteveInterpreter::KEYWORD_INVALID && keyword_help.contains(keyword))
         return keyword_help[keyword];
@@ -164,7 +198,7 @@ void SteveHelp::showHelp()
     {
         SteveInterpreter::KEYWORD t = static_cast<SteveInterpreter::KEYWORD>(keyword_meta.value(i));
         if(t != SteveInterpreter::KEYWORD_INVALID)
-            content.append(QString("<h2>%1</h2>%2").arg(interpreter->str(t)).arg(Qt::convertFromPlainText(getHelp(t))));
+            content.append(QString("<h2>%1</h2>%2").arg(SteveInterpreter::str(t)).arg(Qt::convertFromPlainText(getHelp(t))));
     }
 
     content.append(QObject::trUtf8("</td><td><h1>Anweisungen:</h1>"));
@@ -173,7 +207,7 @@ void SteveHelp::showHelp()
     {
         SteveInterpreter::INSTRUCTION t = static_cast<SteveInterpreter::INSTRUCTION>(instruction_meta.value(i));
         if(t != SteveInterpreter::INSTR_INVALID)
-            content.append(QString("<h2>%1</h2>%2").arg(interpreter->str(t)).arg(Qt::convertFromPlainText(getHelp(t))));
+            content.append(QString("<h2>%1</h2>%2").arg(SteveInterpreter::str(t)).arg(Qt::convertFromPlainText(getHelp(t))));
     }
 
     content.append(QObject::trUtf8("</td><td><h1>Bedingungen:</h1>"));
@@ -182,7 +216,7 @@ void SteveHelp::showHelp()
     {
         SteveInterpreter::CONDITION t = static_cast<SteveInterpreter::CONDITION>(condition_meta.value(i));
         if(t != SteveInterpreter::COND_INVALID)
-            content.append(QString("<h2>%1</h2>%2").arg(interpreter->str(t)).arg(Qt::convertFromPlainText(getHelp(t))));
+            content.append(QString("<h2>%1</h2>%2").arg(SteveInterpreter::str(t)).arg(Qt::convertFromPlainText(getHelp(t))));
     }
 
     content.append(QString("</td></tr></table>"));
@@ -11,6 +11,7 @@ class SteveHelp
 {
 public:
     SteveHelp(SteveInterpreter *interpreter);
+    //The file is only read when a help text is needed first
     SteveHelp(SteveInterpreter *interpreter, QString path);
 
     bool loadFile(QString path);
@@ -24,7 +25,12 @@ public:
     void showHelp();
 
 private:
+    void fillWordList();
+    void ensureLoaded();
+
     SteveInterpreter *interpreter;
+    QString path;
+    bool loaded = false;
     QHash<SteveInterpreter::KEYWORD, QString> keyword_help;
     QHash<SteveInterpreter::INSTRUCTION, QString> instruction_help;
     QHash<SteveInterpreter::CONDITION, QString> condition_help;
@@ -1,8 +1,20 @@
+#include <QElapsedTimer>
+#include <QScrollBar>
+#include <QTextBlock>
+
 #include "stevehighlighter.h"
 
+//How long highlightPending() may block the UI at once
+static const int pending_chunk_ms = 10;
+
 SteveHighlighter::SteveHighlighter(QTextEdit *editor, SteveInterpreter *interpreter)
     : QSyntaxHighlighter{editor->document()}, highlight_line{-1}, interpreter{interpreter}, parent{editor}
 {
+    pending_timer.setSingleShot(true);
+    pending_timer.setInterval(0);
+    connect(&pending_timer, SIGNAL(timeout()), this, SLOT(highlightPending()));
+    connect(editor->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(viewportChanged()));
+
     QTextCharFormat format;
 
     format.setForeground(QColor(0, 128, 0));
@@ -20,84 +32,146 @@ SteveHighlighter::SteveHighlighter(QTextEdit *editor, SteveInterpreter *interpre
 
 void SteveHighlighter::highlightBlock(const QString &text)
 {
-    int line;
-    if(previousBlockState() == -1)
-        line = 0;
-    else
-        line = previousBlockState();
+    //One block is one line
+    const int line = currentBlock().blockNumber();
 
-    QStringList lines = text.split("\n");
-    QString line_str;
-    int line_start = 0;
+    SteveBlockData *data = static_cast<SteveBlockData*>(currentBlockUserData());
 
-    for(int l = 0; l < lines.length(); line_start += line_str.length(), l++, line++)
+    if(!highlight_all && line != highlight_line && !isVisible(line))
     {
-        line_str = lines[l];
-        int highlight_start = -1, highlight_end = -1;
+        if(!data)
+            setCurrentBlockUserData(data = new SteveBlockData);
 
-        if(line == highlight_line)
-        {
-            if(highlight_str.isEmpty())
-            {
-                //Don't set highlight_start and _end here, we still want it highlighted above the background color
-                QTextEdit::ExtraSelection extra_selection;
-                extra_selection.cursor = QTextCursor{parent->document()};
-                extra_selection.cursor.setPosition(line_start + currentBlock().position());
-                highlight_format.setProperty(QTextFormat::FullWidthSelection, true);
-                extra_selection.format = highlight_format;
-
-                QList<QTextEdit::ExtraSelection> extra_selections {extra_selection};
-                parent->setExtraSelections(extra_selections);
-            }
-            else
-            {
-                parent->setExtraSelections({});
-                highlight_start = line_str.indexOf(highlight_str);
-                highlight_end = highlight_start + highlight_str.length();
-                highlight_format.setProperty(QTextFormat::FullWidthSelection, false);
-                QSyntaxHighlighter::setFormat(line_start + highlight_start, highlight_str.length(), highlight_format);
-
-            }
-        }
+        data->pending = true;
+        schedule(line);
+        return;
+    }
 
-        if(interpreter->isComment(line_str))
-            continue; //Don't highlight comments
+    if(data)
+        data->pending = false;
 
-        QString current_token;
-        int current_token_start = line_start;
+    int highlight_start = -1, highlight_end = -1;
 
-        for(int pos = 0; pos < line_str.length(); pos++)
+    if(line == highlight_line)
+    {
+        if(highlight_str.isEmpty())
         {
-            QChar c = line_str.at(pos);
+            //Don't set highlight_start and _end here, we still want it highlighted above the background color
+            QTextEdit::ExtraSelection extra_selection;
+            extra_selection.cursor = QTextCursor{parent->document()};
+            extra_selection.cursor.setPosition(currentBlock().position());
+            highlight_format.setProperty(QTextFormat::FullWidthSelection, true);
+            extra_selection.format = highlight_format;
+
+            QList<QTextEdit::ExtraSelection> extra_selections {extra_selection};
+            parent->setExtraSelections(extra_selections);
+        }
+        else
+        {
+            parent->setExtraSelections({});
+            highlight_start = text.indexOf(highlight_str);
+            highlight_end = highlight_start + highlight_str.length();
+            highlight_format.setProperty(QTextFormat::FullWidthSelection, false);
+            QSyntaxHighlighter::setFormat(highlight_start, highlight_str.length(), highlight_format);
+        }
+    }
 
+    if(interpreter->isComment(text))
+        return; //Don't highlight comments
+
+    int token_start = 0;
+    for(int pos = 0; pos <= text.length(); pos++)
+    {
+        if(pos < text.length())
+        {
+            QChar c = text.at(pos);
             if(!c.isSpace() && c != '(' && c != ')')
-                current_token.append(c);
-
-            if(c.isSpace() || c == '(' || c == ')' || pos == line_str.length() - 1)
-            {
-                current_token = current_token.toLower();
-
-                if(current_token.length() > 0 && !(pos >= highlight_start && pos <= highlight_end))
-                {
-                    if(interpreter->getKeyword(current_token) != -1)
-                        QSyntaxHighlighter::setFormat(current_token_start, current_token.length(), format[TOK_KEYWORD]);
-                    else if(interpreter->getCondition(current_token) != -1)
-                        QSyntaxHighlighter::setFormat(current_token_start, current_token.length(), format[TOK_CONDITION]);
-                    else if(interpreter->getInstruction(current_token) != -1)
-                        QSyntaxHighlighter::setFormat(current_token_start, current_token.length(), format[TOK_INSTRUCTION]);
-                    else if(interpreter->custom_instructions.contains(current_token))
-                        QSyntaxHighlighter::setFormat(current_token_start, current_token.length(), format[TOK_INSTRUCTION]);
-                    else if(interpreter->custom_conditions.contains(current_token))
-                        QSyntaxHighlighter::setFormat(current_token_start, current_token.length(), format[TOK_CONDITION]);
-                }
-
-                current_token.clear();
-                current_token_start = line_start + pos + 1;
-            }
+                continue;
         }
+
+        if(pos > token_start && !(pos >= highlight_start && pos <= highlight_end))
+        {
+            const QString token = text.mid(token_start, pos - token_start).toLower();
+            const int length = pos - token_start;
+
+            if(SteveInterpreter::getKeyword(token) != -1)
+                QSyntaxHighlighter::setFormat(token_start, length, format[TOK_KEYWORD]);
+            else if(SteveInterpreter::getCondition(token) != -1)
+                QSyntaxHighlighter::setFormat(token_start, length, format[TOK_CONDITION]);
+            else if(SteveInterpreter::getInstruction(token) != -1)
+                QSyntaxHighlighter::setFormat(token_start, length, format[TOK_INSTRUCTION]);
+            else if(interpreter->program->custom_instructions.contains(token))
+                QSyntaxHighlighter::setFormat(token_start, length, format[TOK_INSTRUCTION]);
+            else if(interpreter->program->custom_conditions.contains(token))
+                QSyntaxHighlighter::setFormat(token_start, length, format[TOK_CONDITION]);
+        }
+
+        token_start = pos + 1;
     }
+}
+
+bool SteveHighlighter::isPending(const QTextBlock &block)
+{
+    const SteveBlockData *data = static_cast<const SteveBlockData*>(block.userData());
+    return data && data->pending;
+}
+
+//The number of visible lines is estimated from the line height, wrapped lines only make it too large
+bool SteveHighlighter::isVisible(int line) const
+{
+    const int visible_lines = parent->viewport()->height() / parent->fontMetrics().lineSpacing() + 1;
+    return line >= first_visible && line <= first_visible + visible_lines;
+}
+
+void SteveHighlighter::schedule(int line)
+{
+    if(first_pending == -1 || line < first_pending)
+        first_pending = line;
+
+    if(!pending_timer.isActive())
+        pending_timer.start();
+}
+
+//Scrolled lines shouldn't wait for their turn
+void SteveHighlighter::viewportChanged()
+{
+    first_visible = parent->cursorForPosition({0, 0}).blockNumber();
+    if(first_pending == -1)
+        return;
+
+    highlight_all = true;
+    parent->blockSignals(true);
 
-    setCurrentBlockState(line);
+    for(QTextBlock block = document()->findBlockByNumber(first_visible); block.isValid() && isVisible(block.blockNumber()); block = block.next())
+        if(isPending(block))
+            rehighlightBlock(block);
+
+    parent->blockSignals(false);
+    highlight_all = false;
+}
+
+void SteveHighlighter::highlightPending()
+{
+    if(first_pending == -1)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    highlight_all = true;
+    parent->blockSignals(true);
+
+    QTextBlock block = document()->findBlockByNumber(first_pending);
+    for(; block.isValid() && !timer.hasExpired(pending_chunk_ms); block = block.next())
+        if(isPending(block))
+            rehighlightBlock(block);
+
+    parent->blockSignals(false);
+    highlight_all = false;
+
+    first_pending = block.isValid() ? block.blockNumber() : -1;
+    if(first_pending != -1)
+        pending_timer.start();
 }
 
 void SteveHighlighter::setFormat(Token what, const QTextCharFormat &format)
@@ -108,11 +182,31 @@ void SteveHighlighter::setFormat(Token what, const QTextCharFormat &format)
 
 void SteveHighlighter::highlight(int line, const QTextCharFormat &format, const QString &what)
 {
+    const int previous_line = highlight_line;
     highlight_line = line;
     highlight_format = format;
     highlight_str = what;
 
-    rehighlight();
+    //Custom instructions and conditions might have changed
+    if(interpreter->program != highlighted_program)
+    {
+        rehighlight();
+        return;
+    }
+
+    rehighlightLine(previous_line);
+    rehighlightLine(line);
+}
+
+void SteveHighlighter::rehighlightLine(int line)
+{
+    QTextBlock block = document()->findBlockByNumber(line);
+    if(!block.isValid())
+        return;
+
+    parent->blockSignals(true);
+    rehighlightBlock(block);
+    parent->blockSignals(false);
 }
 
 void SteveHighlighter::resetHighlight()
@@ -120,14 +214,17 @@ void SteveHighlighter::resetHighlight()
     if(highlight_line < 0)
         return;
 
+    const int previous_line = highlight_line;
     highlight_line = -1;
 
     parent->setExtraSelections({});
-    rehighlight();
+    rehighlightLine(previous_line);
 }
 
 void SteveHighlighter::rehighlight()
 {
+    highlighted_program = interpreter->program;
+
     parent->blockSignals(true);
     QSyntaxHighlighter::rehighlight();
     parent->blockSignals(false);
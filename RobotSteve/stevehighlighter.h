@@ -3,6 +3,9 @@
 
 #include <QPlainTextEdit>
 #include <QSyntaxHighlighter>
+#include <QTextBlockUserData>
+#include <QTimer>
+#include <memory>
 #include <steveinterpreter.h>
 
 enum Token {
@@ -11,6 +14,16 @@ enum Token {
     TOK_INSTRUCTION
 };
 
+//User data of a block. Others who need the user data of a block (SteveEdit) have to derive from this,
+//a block only has one and the highlighter's flag has to survive replacing it.
+class SteveBlockData : public QTextBlockUserData
+{
+public:
+    bool pending = false; //Not highlighted yet, waits for SteveHighlighter::highlightPending()
+};
+
+//Only the visible lines are highlighted right away, the others in small pieces when the application is idle.
+//That way loading a huge program doesn't block the UI until all of it is highlighted.
 class SteveHighlighter : public QSyntaxHighlighter
 {
     Q_OBJECT
@@ -27,7 +40,23 @@ public slots:
     //This rehighlight doesn't trigger textChanged()
     void rehighlight();
 
+private slots:
+    void viewportChanged();
+    void highlightPending();
+
 private:
+    //Not in the block state, changing that makes QSyntaxHighlighter highlight the next block as well
+    static bool isPending(const QTextBlock &block);
+    bool isVisible(int line) const;
+    void rehighlightLine(int line);
+    void schedule(int line);
+
+    QTimer pending_timer;
+    int first_visible = 0;
+    int first_pending = -1; //No pending block before this one, -1 if there are none
+    bool highlight_all = false; //Set while catching up with the pending blocks
+    std::shared_ptr<const SteveProgram> highlighted_program; //Custom instructions and conditions of this one are highlighted
+
     int highlight_line;
     QString highlight_str;
     SteveInterpreter *interpreter;
@@ -1,8 +1,8 @@
 #include <iostream>
+#include <typeinfo>
 #include <QObject>
 #include <QString>
 #include <QStringList>
-#include <QMap>
 #include <QHash>
 #include <QStack>
 #include <QPixmap>
@@ -22,6 +22,42 @@ struct BlockKeywords {
     BLOCK type;
 };
 
+//How instructions and conditions get to the world. SteveInterpreter uses DirectWorld if the world is exactly a World,
+//then every call is non-virtual and can be inlined. Subclasses like GLWorld need VirtualWorld to hook in.
+struct VirtualWorld {
+    World *world;
+
+    bool stepForward() { return world->stepForward(); }
+    void turnLeft(int quarters) { world->turnLeft(quarters); }
+    void turnRight(int quarters) { world->turnRight(quarters); }
+    bool deposit(unsigned int count) { return world->deposit(count); }
+    bool pickup(unsigned int count) { return world->pickup(count); }
+    void setMark(bool b) { world->setMark(b); }
+    bool isWall() { return world->isWall(); }
+    bool isCube() { return world->isCube(); }
+    bool frontBlocked() { return world->frontBlocked(); }
+    unsigned int getStackSize() { return world->getStackSize(); }
+    bool isMarked() { return world->isMarked(); }
+    ORIENTATION getOrientation() { return world->getOrientation(); }
+};
+
+struct DirectWorld {
+    World *world;
+
+    bool stepForward() { return world->stepForwardDirect(); }
+    void turnLeft(int quarters) { world->turnLeftDirect(quarters); }
+    void turnRight(int quarters) { world->turnRightDirect(quarters); }
+    bool deposit(unsigned int count) { return world->depositDirect(count); }
+    bool pickup(unsigned int count) { return world->pickupDirect(count); }
+    void setMark(bool b) { world->setMarkDirect(b); }
+    bool isWall() { return world->isWallDirect(); }
+    bool isCube() { return world->isCubeDirect(); }
+    bool frontBlocked() { return world->frontBlockedDirect(); }
+    unsigned int getStackSize() { return world->getStackSizeDirect(); }
+    bool isMarked() { return world->isMarkedDirect(); }
+    ORIENTATION getOrientation() { return world->getOrientation(); }
+};
+
 static BlockKeywords blocks[] = {
     DEFAULT_BLOCK_KEYWORDS(IF),
     DEFAULT_BLOCK_KEYWORDS(REPEAT),
@@ -30,7 +66,12 @@ static BlockKeywords blocks[] = {
     DEFAULT_BLOCK_KEYWORDS(NEW_COND)
 };
 
-SteveInterpreter::SteveInterpreter(World *world) : world{world}
+SteveInterpreter::SteveInterpreter(World *world) : world{world}, plain_world{world && typeid(*world) == typeid(World)}, program{std::make_shared<SteveProgram>()}
+{
+    run.frames.reserve(1024);
+}
+
+SteveInterpreter::Language::Language()
 {
     keywords[KEYWORD_IF] = QObject::trUtf8("wenn");
     keywords[KEYWORD_NOT] = QObject::trUtf8("nicht");
@@ -72,65 +113,174 @@ SteveInterpreter::SteveInterpreter(World *world) : world{world}
     conditions[COND_EAST] = QObject::trUtf8("osten");
     conditions[COND_WEST] = QObject::trUtf8("westen");
 
-    condition_functions[COND_ALWAYS] = SteveFunction(this, &SteveInterpreter::condAlways, false);
-    condition_functions[COND_WALL] = SteveFunction(this, &SteveInterpreter::isWall, false);
-    condition_functions[COND_CUBE] = SteveFunction(this, &SteveInterpreter::isCube, false);
-    condition_functions[COND_BRICK] = SteveFunction(this, &SteveInterpreter::isBrick, true);
-    condition_functions[COND_MARKED] = SteveFunction(this, &SteveInterpreter::isMarked, false);
-    condition_functions[COND_NORTH] = SteveFunction(this, &SteveInterpreter::isNorth, false);
-    condition_functions[COND_EAST] = SteveFunction(this, &SteveInterpreter::isEast, false);
-    condition_functions[COND_SOUTH] = SteveFunction(this, &SteveInterpreter::isSouth, false);
-    condition_functions[COND_WEST] = SteveFunction(this, &SteveInterpreter::isWest, false);
-
-    instruction_functions[INSTR_STEP] = SteveFunction(this, &SteveInterpreter::step, true);
-    instruction_functions[INSTR_TURNLEFT] = SteveFunction(this, &SteveInterpreter::turnLeft, true);
-    instruction_functions[INSTR_TURNRIGHT] = SteveFunction(this, &SteveInterpreter::turnRight, true);
-    instruction_functions[INSTR_PUTDOWN] = SteveFunction(this, &SteveInterpreter::deposit, true);
-    instruction_functions[INSTR_PICKUP] = SteveFunction(this, &SteveInterpreter::pickup, true);
-    instruction_functions[INSTR_MARK] = SteveFunction(this, &SteveInterpreter::mark, false);
-    instruction_functions[INSTR_UNMARK] = SteveFunction(this, &SteveInterpreter::unmark, false);
-    instruction_functions[INSTR_BREAKPOINT] = SteveFunction(this, &SteveInterpreter::breakpoint, false);
+    condition_params[COND_ALWAYS] = false;
+    condition_params[COND_WALL] = false;
+    condition_params[COND_CUBE] = false;
+    condition_params[COND_BRICK] = true;
+    condition_params[COND_MARKED] = false;
+    condition_params[COND_NORTH] = false;
+    condition_params[COND_EAST] = false;
+    condition_params[COND_SOUTH] = false;
+    condition_params[COND_WEST] = false;
+
+    instruction_params[INSTR_STEP] = true;
+    instruction_params[INSTR_TURNLEFT] = true;
+    instruction_params[INSTR_TURNRIGHT] = true;
+    instruction_params[INSTR_PUTDOWN] = true;
+    instruction_params[INSTR_PICKUP] = true;
+    instruction_params[INSTR_MARK] = false;
+    instruction_params[INSTR_UNMARK] = false;
+    instruction_params[INSTR_BREAKPOINT] = false;
+
+    for(auto i = keywords.constBegin(); i != keywords.constEnd(); ++i)
+        keyword_lookup[i.value().toLower()] = i.key();
+    for(auto i = instructions.constBegin(); i != instructions.constEnd(); ++i)
+        instruction_lookup[i.value().toLower()] = i.key();
+    for(auto i = conditions.constBegin(); i != conditions.constEnd(); ++i)
+        condition_lookup[i.value().toLower()] = i.key();
+}
+
+//Thread safe, the first call translates the words
+const SteveInterpreter::Language &SteveInterpreter::language()
+{
+    static const Language language;
+    return language;
+}
+
+//The token kinds are set by tokenize(), no string compares needed
+static SteveInterpreter::KEYWORD keywordAt(const TokenLine &line, int i)
+{
+    return static_cast<SteveInterpreter::KEYWORD>(line.id(i, SourceToken::KIND_KEYWORD));
+}
+
+static bool isToken(const TokenLine &line, int i, SteveInterpreter::KEYWORD keyword)
+{
+    return line.id(i, SourceToken::KIND_KEYWORD) == keyword;
 }
 
-void SteveInterpreter::findAndThrowMissingBegin(int line, BLOCK block, const QString &affected) throw (SteveInterpreterException)
+static bool isToken(const TokenLine &line, int i, SteveInterpreter::INSTRUCTION instruction)
+{
+    return line.id(i, SourceToken::KIND_INSTRUCTION) == instruction;
+}
+
+static bool isToken(const TokenLine &line, int i, SteveInterpreter::CONDITION condition)
+{
+    return line.id(i, SourceToken::KIND_CONDITION) == condition;
+}
+
+void SteveInterpreter::findAndThrowMissingBegin(int line, BLOCK block, const QString &affected)
 {
     for(auto block_keywords : blocks)
     {
         if(block_keywords.type == block || (block == BLOCK_ELSE && block_keywords.type == BLOCK_IF))
-            throw SteveInterpreterException{QObject::trUtf8("Es fehlt ein %1.").arg(keywords[block_keywords.begin]), line, affected};
+            throw SteveInterpreterException{QObject::trUtf8("Es fehlt ein %1.").arg(str(block_keywords.begin)), line, affected};
+    }
+}
+
+QByteArray SteveProgram::normalized() const
+{
+    QString result;
+    result.reserve(source.size());
+
+    for(int nr = 0; nr < code.size(); nr++)
+    {
+        if(compiled[nr].type != CompiledLine::TYPE_SKIP)
+        {
+            const TokenLine tokens = line(nr);
+            for(int i = 0; i < tokens.size(); i++)
+            {
+                if(i > 0)
+                    result.append(' ');
+                result.append(tokens[i]);
+            }
+        }
+
+        result.append('\n');
     }
+
+    return result.toUtf8();
 }
 
-void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterException)
+//Splits like simplified().split(" "), but into one string and one array instead of a list per line
+void SteveInterpreter::tokenize(SteveProgram &parsed)
+{
+    int size = 0;
+    for(const QString &line : parsed.code)
+        size += line.size() + 1;
+
+    parsed.source.reserve(size);
+    parsed.tokens.reserve(size / 4);
+    parsed.line_tokens.reserve(parsed.code.size() + 1);
+
+    for(const QString &line : parsed.code)
+    {
+        parsed.line_tokens.append(parsed.tokens.size());
+
+        const int line_offset = parsed.source.size();
+        parsed.source.append(line);
+        parsed.source.append('\n');
+
+        int i = 0;
+        while(i < line.size())
+        {
+            if(line[i].isSpace())
+            {
+                i++;
+                continue;
+            }
+
+            int end = i;
+            while(end < line.size() && !line[end].isSpace())
+                end++;
+
+            SourceToken token{line_offset + i, end - i, SourceToken::KIND_WORD, -1};
+            const QString word = QString::fromRawData(line.constData() + i, end - i);
+            if((token.id = getKeyword(word)) != KEYWORD_INVALID)
+                token.kind = SourceToken::KIND_KEYWORD;
+            else if((token.id = getInstruction(word)) != INSTR_INVALID)
+                token.kind = SourceToken::KIND_INSTRUCTION;
+            else if((token.id = getCondition(word)) != COND_INVALID)
+                token.kind = SourceToken::KIND_CONDITION;
+
+            parsed.tokens.append(token);
+            i = end;
+        }
+    }
+
+    parsed.line_tokens.append(parsed.tokens.size());
+}
+
+void SteveInterpreter::setCode(QStringList code)
 {
     QStack<int> branch_entrys;
     QStack<BLOCK> block_types;
     bool in_custom_condition = false;
 
+    //Visible right away, so the highlighter knows the custom instructions even if parsing fails
+    std::shared_ptr<SteveProgram> parsed_program = std::make_shared<SteveProgram>();
+    SteveProgram &parsed = *parsed_program;
+    program = parsed_program;
     code_valid = false;
-    this->code = code;
-    token.clear();
-    branches.clear();
-    custom_conditions.clear();
-    custom_instructions.clear();
-
-    current_line = code.size() - 1;
-    for(current_line = code.size() - 1; current_line >= 0; current_line--)
+    parsed.code = code;
+    tokenize(parsed);
+    parsed.branches.assign(code.size(), -1);
+
+    run.current_line = code.size() - 1;
+    for(run.current_line = code.size() - 1; run.current_line >= 0; run.current_line--)
     {
-        token[current_line] = code[current_line].simplified().split(" ", QString::SkipEmptyParts);
-        QStringList &line = token[current_line];
+        const TokenLine line = parsed.line(run.current_line);
         if(line.size() == 0 || isComment(line[0]))
             continue;
 
-        if(match(line[0], INSTR_FALSE) || match(line[0], INSTR_TRUE))
+        if(isToken(line, 0, INSTR_FALSE) || isToken(line, 0, INSTR_TRUE))
         {
             if(!in_custom_condition)
-                throw SteveInterpreterException{QObject::trUtf8("%1 und %2 dürfen nur in einer eigenen Bedingung auftreten.").arg(str(INSTR_TRUE)).arg(str(INSTR_FALSE)), current_line};
+                throw SteveInterpreterException{QObject::trUtf8("%1 und %2 dürfen nur in einer eigenen Bedingung auftreten.").arg(str(INSTR_TRUE)).arg(str(INSTR_FALSE)), run.current_line};
 
             continue;
         }
 
-        KEYWORD keyword = getKeyword(line[0]);
+        KEYWORD keyword = keywordAt(line, 0);
         if(keyword == -1)
             continue; //Not a keyword, ignore for now
 
@@ -155,33 +305,33 @@ void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterExceptio
             if(line == -1)
             {
                 if(keyword == KEYWORD_BREAK)
-                    throw SteveInterpreterException(QObject::trUtf8("%1 nur in %2, %3, %4 und %5-Blöcken erlaubt.").arg(str(KEYWORD_BREAK)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_REPEAT)).arg(str(KEYWORD_NEW_INSTR)).arg(str(KEYWORD_NEW_COND)), current_line);
+                    throw SteveInterpreterException(QObject::trUtf8("%1 nur in %2, %3, %4 und %5-Blöcken erlaubt.").arg(str(KEYWORD_BREAK)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_REPEAT)).arg(str(KEYWORD_NEW_INSTR)).arg(str(KEYWORD_NEW_COND)), run.current_line);
                 else if(keyword == KEYWORD_CONTINUE)
-                    throw SteveInterpreterException(QObject::trUtf8("%1 nur in %2 und %3-Blöcken erlaubt.").arg(str(KEYWORD_CONTINUE)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_REPEAT)), current_line);
+                    throw SteveInterpreterException(QObject::trUtf8("%1 nur in %2 und %3-Blöcken erlaubt.").arg(str(KEYWORD_CONTINUE)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_REPEAT)), run.current_line);
             }
 
             if(type == BLOCK_REPEAT || type == BLOCK_WHILE)
-                branches[current_line] = line;
+                parsed.branches[run.current_line] = line;
             else
-                branches[current_line] = line - 1;
+                parsed.branches[run.current_line] = line - 1;
         }
         else if(keyword == KEYWORD_ELSE)
         {
             if(!branch_entrys.size())
-                throw SteveInterpreterException{QObject::trUtf8("Es fehlt ein %1.").arg(str(KEYWORD_IF_END)), current_line, str(KEYWORD_ELSE)};
+                throw SteveInterpreterException{QObject::trUtf8("Es fehlt ein %1.").arg(str(KEYWORD_IF_END)), run.current_line, str(KEYWORD_ELSE)};
 
             BLOCK last_block = block_types.pop();
             if(last_block == BLOCK_IF)
             {
-                branches[current_line] = branch_entrys.pop();
-                branch_entrys.push(current_line);
+                parsed.branches[run.current_line] = branch_entrys.pop();
+                branch_entrys.push(run.current_line);
                 block_types.push(BLOCK_ELSE);
                 continue;
             }
             else
             {
-                findAndThrowMissingBegin(current_line, last_block, str(KEYWORD_ELSE));
-                throw SteveInterpreterException{"WTF #1", current_line};
+                findAndThrowMissingBegin(run.current_line, last_block, str(KEYWORD_ELSE));
+                throw SteveInterpreterException{"WTF #1", run.current_line};
             }
         }
         else
@@ -194,13 +344,13 @@ void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterExceptio
                                 in_custom_condition = true;
 
                     block_types.push(i.type);
-                    branch_entrys.push(current_line);
+                    branch_entrys.push(run.current_line);
                     break;
                 }
                 else if(keyword == i.begin)
                 {
                     if(!branch_entrys.size())
-                        throw SteveInterpreterException{QObject::trUtf8("Es fehlt ein %1.").arg(str(i.end)), current_line, str(i.begin)};
+                        throw SteveInterpreterException{QObject::trUtf8("Es fehlt ein %1.").arg(str(i.end)), run.current_line, str(i.begin)};
 
                     if(keyword == KEYWORD_NEW_COND)
                                 in_custom_condition = false;
@@ -208,13 +358,13 @@ void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterExceptio
                     BLOCK last_block = block_types.pop();
                     if(last_block == i.type || (last_block == BLOCK_ELSE && i.type == BLOCK_IF))
                     {
-                        branches[current_line] = branch_entrys.pop();
+                        parsed.branches[run.current_line] = branch_entrys.pop();
                         break;
                     }
                     else
                     {
-                        findAndThrowMissingBegin(current_line, last_block, str(i.begin));
-                        throw SteveInterpreterException{"WTF #2", current_line};
+                        findAndThrowMissingBegin(run.current_line, last_block, str(i.begin));
+                        throw SteveInterpreterException{"WTF #2", run.current_line};
                     }
                 }
             }
@@ -229,14 +379,14 @@ void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterExceptio
     }
 
     //Now parse a second time
-    for(current_line = 0; current_line < code.size(); current_line++)
+    for(run.current_line = 0; run.current_line < code.size(); run.current_line++)
     {
-        QStringList &line = token[current_line];
+        const TokenLine line = parsed.line(run.current_line);
         //Skip comments or empty lines
         if(line.size() == 0 || isComment(line[0]))
             continue;
 
-        KEYWORD keyword = getKeyword(line[0]);
+        KEYWORD keyword = keywordAt(line, 0);
         if(keyword == KEYWORD_INVALID)
             continue; //Not a keyword, ignore for now
 
@@ -251,33 +401,33 @@ void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterExceptio
                         BLOCK in = block_types.pop();
                         for(auto bk : blocks)
                             if(bk.type == in)
-                                throw SteveInterpreterException{QObject::trUtf8("%1 ist nicht in einem %2-Block erlaubt.").arg(str(i.begin)).arg(str(bk.begin)), current_line};
+                                throw SteveInterpreterException{QObject::trUtf8("%1 ist nicht in einem %2-Block erlaubt.").arg(str(i.begin)).arg(str(bk.begin)), run.current_line};
 
-                        throw SteveInterpreterException{QObject::trUtf8("WTF #4"), current_line};
+                        throw SteveInterpreterException{QObject::trUtf8("WTF #4"), run.current_line};
                     }
 
                     if(line.size() == 1)
-                        throw SteveInterpreterException{QObject::trUtf8("Bezeichnung fehlt."), current_line};
+                        throw SteveInterpreterException{QObject::trUtf8("Bezeichnung fehlt."), run.current_line};
                     else if(line.size() > 2)
-                        throw SteveInterpreterException{QObject::trUtf8("Zu viele Bezeichnungen."), current_line};
+                        throw SteveInterpreterException{QObject::trUtf8("Zu viele Bezeichnungen."), run.current_line};
 
                     QString name = line[1].toLower();
                     QRegExp validName("^(\\w|\\d)+$");
 
                     if(!validName.exactMatch(name))
-                        throw SteveInterpreterException{QObject::trUtf8("Die Bezeichnung %1 enthält ungültige Zeichen.").arg(line[1]), current_line, line[1]};
+                        throw SteveInterpreterException{QObject::trUtf8("Die Bezeichnung %1 enthält ungültige Zeichen.").arg(line[1]), run.current_line, line[1]};
 
                     if(getKeyword(name) != KEYWORD_INVALID || getInstruction(name) != INSTR_INVALID || getCondition(name) != COND_INVALID)
-                        throw SteveInterpreterException{QObject::trUtf8("Die Bezeichnung %1 ist ein reserviertes Wort.").arg(line[1]), current_line, line[1]};
+                        throw SteveInterpreterException{QObject::trUtf8("Die Bezeichnung %1 ist ein reserviertes Wort.").arg(line[1]), run.current_line, line[1]};
 
-                    auto &customSymbols = i.type == BLOCK_NEW_COND ? custom_conditions : custom_instructions;
+                    auto &customSymbols = i.type == BLOCK_NEW_COND ? parsed.custom_conditions : parsed.custom_instructions;
                     if(customSymbols.contains(name))
-                        throw SteveInterpreterException{QObject::trUtf8("%1 %2 existiert schon in Zeile %3").arg(str(i.begin)).arg(line[1]).arg(customSymbols[name]), current_line, line[1]};
+                        throw SteveInterpreterException{QObject::trUtf8("%1 %2 existiert schon in Zeile %3").arg(str(i.begin)).arg(line[1]).arg(customSymbols[name] + 1), run.current_line, line[1]};
 
-                    customSymbols[name] = current_line;
+                    customSymbols[name] = run.current_line;
                 }
                 block_types.push(i.type);
-                branch_entrys.push(current_line);
+                branch_entrys.push(run.current_line);
                 break; //Keyword found
             }
             else if(keyword == i.end)
@@ -287,21 +437,21 @@ void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterExceptio
                     BLOCK last_block = block_types.pop();
                     if(last_block == i.type)
                     {
-                        branches[current_line] = branch_entrys.pop();
+                        parsed.branches[run.current_line] = branch_entrys.pop();
 
                         if(keyword == KEYWORD_REPEAT_END)
                         {
-                            if(line.size() != 1 && token[branches[current_line]].size() != 1)
-                                throw SteveInterpreterException{QObject::trUtf8("Hier darf keine Bedingung sein, da in Zeile %1 eine angegeben wurde.").arg(branches[current_line]), current_line};
+                            if(line.size() != 1 && parsed.line(parsed.branches[run.current_line]).size() != 1)
+                                throw SteveInterpreterException{QObject::trUtf8("Hier darf keine Bedingung sein, da in Zeile %1 eine angegeben wurde.").arg(parsed.branches[run.current_line] + 1), run.current_line};
 
-                            if(line.size() == 1 && token[branches[current_line]].size() == 1)
-                                throw SteveInterpreterException{QObject::trUtf8("Hier wird eine Bedingung benötigt, da in Zeile %1 keine angegeben wurde.").arg(branches[current_line]), current_line};
+                            if(line.size() == 1 && parsed.line(parsed.branches[run.current_line]).size() == 1)
+                                throw SteveInterpreterException{QObject::trUtf8("Hier wird eine Bedingung benötigt, da in Zeile %1 keine angegeben wurde.").arg(parsed.branches[run.current_line] + 1), run.current_line};
                         }
 
                         break; //Keyword found
                     }
                 }
-                throw SteveInterpreterException{QObject::trUtf8("WTF #5"), current_line};
+                throw SteveInterpreterException{QObject::trUtf8("WTF #5"), run.current_line};
             }
         }
     }
@@ -309,675 +459,1187 @@ void SteveInterpreter::setCode(QStringList code) throw (SteveInterpreterExceptio
     if(branch_entrys.size())
         throw SteveInterpreterException{"WTF #6", code.size() - 1};
 
+    compile(parsed);
     reset();
 
     code_valid = true;
 }
 
+void SteveInterpreter::setProgram(std::shared_ptr<const SteveProgram> program)
+{
+    if(program)
+    {
+        this->program = program;
+        code_valid = true;
+    }
+    else
+    {
+        this->program = std::make_shared<SteveProgram>();
+        code_valid = false;
+    }
+
+    reset();
+}
+
 void SteveInterpreter::reset()
 {
-    current_line = 0;
-    stack.clear();
-    loop_count.clear();
-    custom_condition_return_stack.clear();
-    coming_from_condition = coming_from_repeat_end = coming_from_break = enter_sub = enter_else = execution_finished = hit_breakpoint = false;
+    //Keeps the memory of the frames
+    std::vector<StackFrame> frames = std::move(run.frames);
+    frames.clear();
+
+    run = RunState{};
+    run.frames = std::move(frames);
+    run.timer.start();
+    run.line_hits.fill(0, profiling ? program->code.size() : 0);
+    run.line_actions.fill(0, profiling ? program->code.size() : 0);
+}
+
+void SteveInterpreter::setProfiling(bool enabled)
+{
+    profiling = enabled;
+    run.line_hits.fill(0, profiling ? program->code.size() : 0);
+    run.line_actions.fill(0, profiling ? program->code.size() : 0);
+}
+
+ExecutionStatistics SteveInterpreter::getStatistics() const
+{
+    ExecutionStatistics ret = run.statistics;
+    if(!run.execution_finished && run.timer.isValid())
+        ret.time_ms = run.timer.elapsed();
+
+    return ret;
+}
+
+//Remembers the error in the current line, always returns false
+bool SteveInterpreter::fail(STEVE_ERROR id, const QString &argument, const QString &affected)
+{
+    run.error.id = id;
+    run.error.line = run.current_line;
+    //Copies, both can point into the tokens of the program
+    run.error.argument = QString(argument.constData(), argument.size());
+    run.error.affected = QString(affected.constData(), affected.size());
+
+    return false;
+}
+
+bool SteveInterpreter::failBudgetExceeded(STEVE_ERROR id)
+{
+    run.budget_exceeded = true;
+    run.statistics.time_ms = run.timer.elapsed();
+
+    return fail(id);
+}
+
+//Called for every executed line, current_line has to be set
+bool SteveInterpreter::countLine()
+{
+    if(++run.statistics.lines > budget.max_lines && budget.max_lines)
+        return failBudgetExceeded(ERROR_LIMIT_LINES);
+
+    if(profiling)
+        run.line_hits[run.current_line]++;
+
+    //Looking at the clock is expensive, do it only every 1024 lines
+    if(budget.max_time_ms && (run.statistics.lines & 1023) == 0 && run.timer.elapsed() > budget.max_time_ms)
+        return failBudgetExceeded(ERROR_LIMIT_TIME);
+
+    return true;
+}
+
+//Called for every change of the world
+bool SteveInterpreter::countAction()
+{
+    if(profiling)
+        run.line_actions[run.current_line]++;
+
+    if(++run.statistics.actions > budget.max_actions && budget.max_actions)
+        return failBudgetExceeded(ERROR_LIMIT_ACTIONS);
+
+    return true;
+}
+
+//Built-in instruction (without quit, true, false and stop) or built-in condition, otherwise false
+bool SteveInterpreter::compileCall(const QString &call, CompiledLine &compiled_line, bool condition)
+{
+    QRegExp call_regexp("^((\\w|\\d)+)(\\((\\d+)\\))?$");
+    if(call_regexp.indexIn(call) == -1)
+        return false;
+
+    bool param_allowed;
+    if(condition)
+    {
+        CONDITION cond = getCondition(call_regexp.cap(1));
+        if(cond == COND_INVALID || !language().condition_params.contains(cond))
+            return false;
+
+        param_allowed = language().condition_params[cond];
+        compiled_line.condition = cond;
+    }
+    else
+    {
+        INSTRUCTION instr = getInstruction(call_regexp.cap(1));
+        if(instr == INSTR_INVALID || instr == INSTR_QUIT || instr == INSTR_TRUE || instr == INSTR_FALSE || instr == INSTR_BREAKPOINT
+                || !language().instruction_params.contains(instr))
+            return false;
+
+        param_allowed = language().instruction_params[instr];
+        compiled_line.instruction = instr;
+    }
+
+    compiled_line.has_param = !call_regexp.cap(4).isEmpty();
+    compiled_line.param = compiled_line.has_param ? call_regexp.cap(4).toInt() : 1;
+
+    //Errors are reported by the token path
+    return !compiled_line.has_param || param_allowed;
+}
+
+//Custom instruction call followed only by *wenn (and comments) up to *anweisung
+bool SteveInterpreter::isTailCall(const SteveProgram &parsed, int line_nr)
+{
+    QRegExp call_regexp("^((\\w|\\d)+)$");
+    if(call_regexp.indexIn(parsed.line(line_nr)[0]) == -1 || !parsed.custom_instructions.contains(call_regexp.cap(1).toLower()))
+        return false;
+
+    for(line_nr++; line_nr < parsed.code.size(); line_nr++)
+    {
+        const TokenLine line = parsed.line(line_nr);
+        if(line.size() == 0 || isComment(line[0]))
+            continue;
+
+        if(line.size() != 1)
+            return false;
+
+        KEYWORD keyword = keywordAt(line, 0);
+        if(keyword == KEYWORD_NEW_INSTR_END)
+            return true;
+        else if(keyword != KEYWORD_IF_END)
+            return false;
+    }
+
+    return false;
+}
+
+void SteveInterpreter::compile(SteveProgram &parsed)
+{
+    parsed.compiled.fill(CompiledLine(), parsed.code.size());
+
+    for(int line_nr = 0; line_nr < parsed.code.size(); line_nr++)
+    {
+        const TokenLine line = parsed.line(line_nr);
+        CompiledLine &compiled_line = parsed.compiled[line_nr];
+
+        if(line.size() == 0 || parsed.code[line_nr].isEmpty() || isComment(line[0]))
+        {
+            compiled_line.type = CompiledLine::TYPE_SKIP;
+            continue;
+        }
+
+        KEYWORD keyword = keywordAt(line, 0);
+        if(keyword == KEYWORD_INVALID)
+        {
+            if(line.size() == 1 && compileCall(line[0], compiled_line, false))
+                compiled_line.type = CompiledLine::TYPE_INSTRUCTION;
+        }
+        else if(keyword == KEYWORD_IF)
+        {
+            compiled_line.inverted = line.size() == 4 && isToken(line, 1, KEYWORD_NOT) && isToken(line, 3, KEYWORD_THEN);
+            if((compiled_line.inverted || (line.size() == 3 && isToken(line, 2, KEYWORD_THEN)))
+                    && compileCall(line[compiled_line.inverted ? 2 : 1], compiled_line, true))
+                compiled_line.type = CompiledLine::TYPE_IF;
+        }
+        else if(keyword == KEYWORD_WHILE)
+        {
+            compiled_line.inverted = line.size() == 3 && isToken(line, 1, KEYWORD_NOT);
+            if((compiled_line.inverted || line.size() == 2)
+                    && compileCall(line[compiled_line.inverted ? 2 : 1], compiled_line, true))
+                compiled_line.type = CompiledLine::TYPE_WHILE;
+        }
+
+        if(compiled_line.type == CompiledLine::TYPE_TOKENS)
+        {
+            compiled_line = CompiledLine();
+            compiled_line.tail_call = keyword == KEYWORD_INVALID && line.size() == 1 && isTailCall(parsed, line_nr);
+        }
+    }
+
+    //Find the runs of instructions, backwards
+    int next_other = parsed.code.size();
+    for(int line_nr = parsed.code.size() - 1; line_nr >= 0; line_nr--)
+    {
+        CompiledLine &compiled_line = parsed.compiled[line_nr];
+        compiled_line.run_end = next_other;
+
+        //Blocks with only instructions inside and a valid end
+        if(compiled_line.type == CompiledLine::TYPE_IF || compiled_line.type == CompiledLine::TYPE_WHILE)
+        {
+            int end = parsed.branches[line_nr];
+            KEYWORD end_keyword = compiled_line.type == CompiledLine::TYPE_IF ? KEYWORD_IF_END : KEYWORD_WHILE_END;
+            compiled_line.fused = next_other == end && parsed.line(end).size() == 1 && isToken(parsed.line(end), 0, end_keyword);
+        }
+
+        if(compiled_line.type != CompiledLine::TYPE_INSTRUCTION && compiled_line.type != CompiledLine::TYPE_SKIP)
+            next_other = line_nr;
+    }
+}
+
+bool SteveInterpreter::evaluate(const CompiledLine &compiled_line)
+{
+    CONDITION condition = static_cast<CONDITION>(compiled_line.condition);
+    bool result;
+    if(plain_world)
+        result = evaluateCondition(DirectWorld{world}, condition, compiled_line.has_param, compiled_line.param);
+    else
+        result = evaluateCondition(VirtualWorld{world}, condition, compiled_line.has_param, compiled_line.param);
+
+    return result != compiled_line.inverted;
+}
+
+template <typename WORLD>
+bool SteveInterpreter::evaluateCondition(WORLD world, CONDITION condition, bool has_param, int param)
+{
+    switch(condition)
+    {
+    case COND_WALL:
+        return world.frontBlocked();
+    case COND_CUBE:
+        return world.isCube();
+    case COND_BRICK:
+        return has_param ? world.getStackSize() == static_cast<unsigned int>(param) : world.getStackSize() > 0;
+    case COND_MARKED:
+        return world.isMarked();
+    case COND_NORTH:
+        return world.getOrientation() == ORIENT_NORTH;
+    case COND_EAST:
+        return world.getOrientation() == ORIENT_EAST;
+    case COND_SOUTH:
+        return world.getOrientation() == ORIENT_SOUTH;
+    case COND_WEST:
+        return world.getOrientation() == ORIENT_WEST;
+    case COND_ALWAYS:
+    default:
+        return true;
+    }
+}
+
+//Quit, true and false are handled by handleInstruction
+template <typename WORLD>
+bool SteveInterpreter::executeInstruction(WORLD world, INSTRUCTION instruction, bool has_param, int param)
+{
+    if(!has_param)
+        param = 1;
+
+    switch(instruction)
+    {
+    case INSTR_STEP:
+        while(param--)
+        {
+            if(!countAction())
+                return false;
+
+            if(!world.stepForward())
+                return fail(ERROR_WALK_INTO_WALL);
+        }
+
+        return true;
+    case INSTR_TURNLEFT:
+        if(!countAction())
+            return false;
+
+        world.turnLeft(param);
+        return true;
+    case INSTR_TURNRIGHT:
+        if(!countAction())
+            return false;
+
+        world.turnRight(param);
+        return true;
+    case INSTR_PUTDOWN:
+        if(world.isWall())
+            return fail(ERROR_FACING_WALL);
+
+        if(!countAction())
+            return false;
+
+        if(!world.deposit(param))
+            return fail(ERROR_MAX_HEIGHT);
+
+        return true;
+    case INSTR_PICKUP:
+        if(world.isWall())
+            return fail(ERROR_FACING_WALL);
+
+        if(!countAction())
+            return false;
+
+        if(!world.pickup(param))
+            return fail(ERROR_NOT_ENOUGH_BRICKS);
+
+        return true;
+    case INSTR_MARK:
+    case INSTR_UNMARK:
+        if(!countAction())
+            return false;
+
+        world.setMark(instruction == INSTR_MARK);
+        return true;
+    case INSTR_BREAKPOINT:
+        run.hit_breakpoint = true;
+        return true;
+    default:
+        return fail(ERROR_INTERNAL, "#8");
+    }
+}
+
+//Built-in instruction, false if it failed
+bool SteveInterpreter::call(const CompiledLine &compiled_line)
+{
+    INSTRUCTION instruction = static_cast<INSTRUCTION>(compiled_line.instruction);
+    if(plain_world)
+        return executeInstruction(DirectWorld{world}, instruction, compiled_line.has_param, compiled_line.param);
+
+    return executeInstruction(VirtualWorld{world}, instruction, compiled_line.has_param, compiled_line.param);
 }
 
-bool SteveInterpreter::handleCondition(QString condition_str, bool &result) throw (SteveInterpreterException)
+//Executes the instructions in [from, end), which are all TYPE_INSTRUCTION or TYPE_SKIP
+bool SteveInterpreter::executeRun(int from, int end)
+{
+    for(int line_nr = from; line_nr < end; line_nr++)
+    {
+        const CompiledLine &compiled_line = program->compiled[line_nr];
+        if(compiled_line.type == CompiledLine::TYPE_SKIP)
+            continue;
+
+        run.current_line = line_nr;
+        if(!countLine() || !call(compiled_line))
+            return false;
+    }
+
+    return true;
+}
+
+//Fast path for compiled lines, the line is already counted. handled is false if the token path has to do it.
+bool SteveInterpreter::executeCompiled(bool &handled)
+{
+    const CompiledLine &compiled_line = program->compiled[run.current_line];
+    handled = true;
+
+    switch(compiled_line.type)
+    {
+    case CompiledLine::TYPE_INSTRUCTION:
+        if(!call(compiled_line))
+            return false;
+
+        if(fusion)
+        {
+            if(!executeRun(run.current_line + 1, compiled_line.run_end))
+                return false;
+
+            run.current_line = compiled_line.run_end;
+        }
+        else
+            run.current_line++;
+
+        return true;
+
+    case CompiledLine::TYPE_IF:
+    {
+        //Result of a custom condition pending, can't happen for built-in conditions, but be safe
+        if(run.coming_from_condition)
+        {
+            handled = false;
+            return true;
+        }
+
+        run.coming_from_repeat_end = false;
+
+        bool result = evaluate(compiled_line);
+        run.enter_else = !result;
+
+        if(!fusion || !compiled_line.fused)
+        {
+            run.current_line = result ? run.current_line + 1 : program->branches[run.current_line];
+            return true;
+        }
+
+        //wenn ... *wenn in one go
+        int end = program->branches[run.current_line];
+        if(result && !executeRun(run.current_line + 1, end))
+            return false;
+
+        run.current_line = end;
+        if(!countLine())
+            return false;
+
+        run.current_line++;
+
+        return true;
+    }
+
+    case CompiledLine::TYPE_WHILE:
+    {
+        if(run.coming_from_condition)
+        {
+            handled = false;
+            return true;
+        }
+
+        run.coming_from_repeat_end = false;
+
+        const int start = run.current_line, end = program->branches[run.current_line];
+        if(!fusion || !compiled_line.fused)
+        {
+            run.current_line = evaluate(compiled_line) ? run.current_line + 1 : end + 1;
+            return true;
+        }
+
+        //solange ... *solange in one go, but return once in a while so the GUI stays responsive
+        for(int iteration = 0; iteration < 1024; iteration++)
+        {
+            if(iteration > 0)
+            {
+                run.current_line = start;
+                if(!countLine())
+                    return false;
+            }
+
+            if(!evaluate(compiled_line))
+            {
+                run.current_line = end + 1;
+                return true;
+            }
+
+            if(!executeRun(start + 1, end))
+                return false;
+
+            run.current_line = end;
+            if(!countLine())
+                return false;
+        }
+
+        //Continue with the condition next time
+        run.current_line = start;
+        return true;
+    }
+
+    default:
+        handled = false;
+        return true;
+    }
+}
+
+void SteveInterpreter::pushCall()
+{
+    run.frames.push_back({StackFrame::FRAME_CALL, true, run.current_line});
+}
+
+bool SteveInterpreter::popCall(StackFrame &frame)
+{
+    //Counted loops which were not left regularly
+    while(!run.frames.empty() && run.frames.back().type == StackFrame::FRAME_LOOP)
+        run.frames.pop_back();
+
+    if(run.frames.empty())
+        return fail(ERROR_INTERNAL, "#9");
+
+    frame = run.frames.back();
+    run.frames.pop_back();
+    return true;
+}
+
+//Frame of the innermost custom instruction or condition, nullptr if there is none
+SteveInterpreter::StackFrame *SteveInterpreter::callFrame()
+{
+    for(auto frame = run.frames.rbegin(); frame != run.frames.rend(); ++frame)
+        if(frame->type == StackFrame::FRAME_CALL)
+            return &*frame;
+
+    fail(ERROR_INTERNAL, "#9");
+    return nullptr;
+}
+
+SteveInterpreter::CALL_RESULT SteveInterpreter::handleCondition(const QString &condition_str, bool &result)
 {
     QRegExp condition_regexp("^((\\w|\\d)+)(\\((\\d+)\\))?$");
     if(condition_regexp.indexIn(condition_str) == -1)
-        throw SteveInterpreterException(QObject::trUtf8("Ungültige Bedingung."), current_line, condition_str);
+    {
+        fail(ERROR_INVALID_CONDITION, QString(), condition_str);
+        return CALL_FAILED;
+    }
 
     CONDITION condition = getCondition(condition_regexp.cap(1));
     if(condition != COND_INVALID)
     {
-        if(!condition_functions.contains(condition))
-            throw SteveInterpreterException{QObject::trUtf8("WTF #7"), current_line};
+        if(!language().condition_params.contains(condition))
+        {
+            fail(ERROR_INTERNAL, "#7");
+            return CALL_FAILED;
+        }
 
-        SteveFunction &func = condition_functions[condition];
         //Argument given
-        if(!condition_regexp.cap(4).isEmpty())
+        const bool has_param = !condition_regexp.cap(4).isEmpty();
+        if(has_param && !language().condition_params[condition])
         {
-            if(!func.hasParam())
-                throw SteveInterpreterException{QObject::trUtf8("Bedingung %1 kann mit einem Argument nichts anfangen.").arg(condition_regexp.cap(1)), current_line, condition_regexp.cap(3)};
-
-            result = func(world, condition_regexp.cap(4).toInt());
+            fail(ERROR_CONDITION_PARAM, condition_regexp.cap(1), condition_regexp.cap(3));
+            return CALL_FAILED;
         }
+
+        const int param = has_param ? condition_regexp.cap(4).toInt() : 1;
+        if(plain_world)
+            result = evaluateCondition(DirectWorld{world}, condition, has_param, param);
         else
-            result = func(world);
+            result = evaluateCondition(VirtualWorld{world}, condition, has_param, param);
 
-        return true;
+        return CALL_DONE;
     }
-    else if(custom_conditions.contains(condition_regexp.cap(1).toLower()))
+    else if(program->custom_conditions.contains(condition_regexp.cap(1).toLower()))
     {
-        stack.push(current_line);
-        enter_sub = true;
-        current_line = custom_conditions[condition_regexp.cap(1).toLower()];
-        return false;
+        pushCall();
+        run.enter_sub = true;
+        run.current_line = program->custom_conditions[condition_regexp.cap(1).toLower()];
+        return CALL_JUMPED;
     }
-    else
-        throw SteveInterpreterException{QObject::trUtf8("Ich kenne die Bedingung %1 nicht.").arg(condition_regexp.cap(1)), current_line, condition_regexp.cap(1)};
+
+    fail(ERROR_UNKNOWN_CONDITION, condition_regexp.cap(1), condition_regexp.cap(1));
+    return CALL_FAILED;
 }
 
-bool SteveInterpreter::handleInstruction(QString instruction_str) throw (SteveInterpreterException)
+SteveInterpreter::CALL_RESULT SteveInterpreter::handleInstruction(const QString &instruction_str)
 {
     QRegExp instruction_regexp("^((\\w|\\d)+)(\\((\\d+)\\))?$");
     if(instruction_regexp.indexIn(instruction_str) == -1)
-        throw SteveInterpreterException{QObject::trUtf8("Ungültige Anweisung."), current_line, instruction_str};
+    {
+        fail(ERROR_INVALID_INSTRUCTION, QString(), instruction_str);
+        return CALL_FAILED;
+    }
 
     INSTRUCTION instruction = getInstruction(instruction_regexp.cap(1));
     if(instruction != INSTR_INVALID)
     {
-        if(instruction == INSTR_TRUE)
-        {
-            custom_condition_return_stack.top() = true;
-            return true;
-        }
-        else if(instruction == INSTR_FALSE)
+        if(instruction == INSTR_TRUE || instruction == INSTR_FALSE)
         {
-            custom_condition_return_stack.top() = false;
-            return true;
+            StackFrame *frame = callFrame();
+            if(!frame)
+                return CALL_FAILED;
+
+            frame->result = instruction == INSTR_TRUE;
+            return CALL_DONE;
         }
         else if(instruction == INSTR_QUIT)
         {
-            execution_finished = true;
-            return false;
+            run.execution_finished = true;
+            run.statistics.time_ms = run.timer.elapsed();
+            return CALL_JUMPED;
         }
 
-        if(!instruction_functions.contains(instruction))
-            throw SteveInterpreterException{QObject::trUtf8("WTF #8"), current_line};
+        if(!language().instruction_params.contains(instruction))
+        {
+            fail(ERROR_INTERNAL, "#8");
+            return CALL_FAILED;
+        }
 
-        SteveFunction &func = instruction_functions[instruction];
         //Argument given
-        if(!instruction_regexp.cap(4).isEmpty())
+        const bool has_param = !instruction_regexp.cap(4).isEmpty();
+        if(has_param && !language().instruction_params[instruction])
         {
-            if(!func.hasParam())
-                throw SteveInterpreterException{QObject::trUtf8("Anweisung %1 kann mit einem Argument nichts anfangen!").arg(instruction_regexp.cap(1)), current_line, instruction_regexp.cap(3)};
-
-            func(world, instruction_regexp.cap(4).toInt());
+            fail(ERROR_INSTRUCTION_PARAM, instruction_regexp.cap(1), instruction_regexp.cap(3));
+            return CALL_FAILED;
         }
+
+        const int param = has_param ? instruction_regexp.cap(4).toInt() : 1;
+        bool success;
+        if(plain_world)
+            success = executeInstruction(DirectWorld{world}, instruction, has_param, param);
         else
-            func(world);
+            success = executeInstruction(VirtualWorld{world}, instruction, has_param, param);
+
+        return success ? CALL_DONE : CALL_FAILED;
+    }
+    else if(program->custom_instructions.contains(instruction_regexp.cap(1).toLower()))
+    {
+        //Nothing left to do in the calling instruction: Reuse its frame, so endless recursion doesn't need an endless stack
+        if(!program->compiled[run.current_line].tail_call || run.frames.empty() || run.frames.back().type != StackFrame::FRAME_CALL)
+            pushCall();
+
+        run.enter_sub = true;
+        run.current_line = program->custom_instructions[instruction_regexp.cap(1).toLower()];
+        return CALL_JUMPED;
+    }
+
+    fail(ERROR_UNKNOWN_INSTRUCTION, instruction_regexp.cap(1), instruction_regexp.cap(1));
+    return CALL_FAILED;
+}
+
+void SteveInterpreter::executeLine()
+{
+    SteveError error;
+    if(executeLine(error))
+        return;
+
+    //Only now the message and the backtrace are needed
+    SteveInterpreterException e{errorMessage(error), error.line, error.affected};
+    int depth;
+    QVector<BacktraceEntry> entries = errorBacktrace(error, depth);
+    e.setBacktrace(entries, depth);
+    throw e;
+}
 
+bool SteveInterpreter::executeLine(SteveError &error)
+{
+    if(executeLineUnchecked() && (!loop_detection || run.execution_finished || checkLoop()))
         return true;
+
+    error = run.error;
+    return false;
+}
+
+QString SteveInterpreter::errorMessage(const SteveError &error) const
+{
+    switch(error.id)
+    {
+    case ERROR_NONE:
+        return {};
+    case ERROR_CODE_INVALID:
+        return QObject::trUtf8("Der Code enthält Fehler.");
+    case ERROR_STACK_OVERFLOW:
+        return QObject::trUtf8("Der Stack wird langsam ein bisschen zu groß..");
+    case ERROR_SYNTAX_IF:
+        return QObject::trUtf8("Syntax: %1 [%2] [bedingung] %3").arg(str(KEYWORD_IF)).arg(str(KEYWORD_NOT)).arg(str(KEYWORD_THEN));
+    case ERROR_SYNTAX_KEYWORD:
+        return QObject::trUtf8("Syntax: %1").arg(error.argument);
+    case ERROR_SYNTAX_REPEAT:
+        return QObject::trUtf8("Syntax: %1\n%1 [zahl] %2\n%1 %3 [%4] [bedingung]\n%1 %5").arg(str(KEYWORD_REPEAT)).arg(str(KEYWORD_TIMES))
+                .arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT)).arg(str(COND_ALWAYS));
+    case ERROR_SYNTAX_REPEAT_END:
+        return QObject::trUtf8("Syntax: %1\n%1 %2 [%3] [bedingung]").arg(str(KEYWORD_REPEAT_END)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT));
+    case ERROR_SYNTAX_REPEAT_END_CONDITION:
+        return QObject::trUtf8("Syntax: %1 %2 [%3] [bedingung]").arg(str(KEYWORD_REPEAT_END)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT));
+    case ERROR_SYNTAX_WHILE:
+        return QObject::trUtf8("Syntax: %1 [%2] [bedingung]").arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT));
+    case ERROR_NOT_A_NUMBER:
+        return QObject::trUtf8("%1 ist keine Zahl.").arg(error.argument);
+    case ERROR_COUNT_RANGE:
+        return QObject::trUtf8("Die Zahl muss >= 0 und kleiner als 10000 sein.");
+    case ERROR_NO_SENSE:
+        return QObject::trUtf8("%1 macht hier keinen Sinn.").arg(error.argument);
+    case ERROR_INVALID_INSTRUCTION:
+        return QObject::trUtf8("Ungültige Anweisung.");
+    case ERROR_INVALID_CONDITION:
+        return QObject::trUtf8("Ungültige Bedingung.");
+    case ERROR_INSTRUCTION_PARAM:
+        return QObject::trUtf8("Anweisung %1 kann mit einem Argument nichts anfangen!").arg(error.argument);
+    case ERROR_CONDITION_PARAM:
+        return QObject::trUtf8("Bedingung %1 kann mit einem Argument nichts anfangen.").arg(error.argument);
+    case ERROR_UNKNOWN_INSTRUCTION:
+        return QObject::trUtf8("Ich kenne die Anweisung %1 nicht.").arg(error.argument);
+    case ERROR_UNKNOWN_CONDITION:
+        return QObject::trUtf8("Ich kenne die Bedingung %1 nicht.").arg(error.argument);
+    case ERROR_FACING_WALL:
+        return QObject::trUtf8("Steve steht vor einer Wand und weiß nicht, was er jetzt tun soll.");
+    case ERROR_NOT_ENOUGH_BRICKS:
+        return QObject::trUtf8("Steve sieht nicht genug Ziegel zum Aufheben.");
+    case ERROR_MAX_HEIGHT:
+        return QObject::trUtf8("Maximale Höhe erreicht.\nSteve kann nicht höher heben, er hat einen Bandscheibenvorfall.");
+    case ERROR_WALK_INTO_WALL:
+        return QObject::trUtf8("Steve war so dumm und ist gegen die Wand gelaufen!");
+    case ERROR_LIMIT_LINES:
+        return QObject::trUtf8("Das Programm hat das Limit von %1 überschritten.").arg(QObject::trUtf8("%1 Zeilen").arg(budget.max_lines));
+    case ERROR_LIMIT_ACTIONS:
+        return QObject::trUtf8("Das Programm hat das Limit von %1 überschritten.").arg(QObject::trUtf8("%1 Aktionen").arg(budget.max_actions));
+    case ERROR_LIMIT_TIME:
+        return QObject::trUtf8("Das Programm hat das Limit von %1 überschritten.").arg(QObject::trUtf8("%1 ms").arg(budget.max_time_ms));
+    case ERROR_ENDLESS_LOOP:
+        return QObject::trUtf8("Das Programm wird nie fertig, es wiederholt immer wieder dasselbe.");
+    case ERROR_INTERNAL:
+        return QObject::trUtf8("WTF %1").arg(error.argument);
     }
-    else if(custom_instructions.contains(instruction_regexp.cap(1).toLower()))
+
+    return {};
+}
+
+//Name of the custom instruction or condition the line is in
+QString SteveInterpreter::functionAt(int line) const
+{
+    for(auto i = program->custom_instructions.constBegin(); i != program->custom_instructions.constEnd(); ++i)
+        if(line >= i.value() && line <= program->branches[i.value()])
+            return i.key();
+
+    for(auto i = program->custom_conditions.constBegin(); i != program->custom_conditions.constEnd(); ++i)
+        if(line >= i.value() && line <= program->branches[i.value()])
+            return i.key();
+
+    return {};
+}
+
+//From the call frames, tail calls don't leave a trace
+QVector<BacktraceEntry> SteveInterpreter::errorBacktrace(const SteveError &error, int &depth) const
+{
+    const int MAX_BACKTRACE = 50;
+
+    QVector<BacktraceEntry> entries;
+    entries.append({error.line, functionAt(error.line)});
+    depth = 1;
+
+    for(auto frame = run.frames.rbegin(); frame != run.frames.rend(); ++frame)
     {
-        stack.push(current_line);
-        enter_sub = true;
-        current_line = custom_instructions[instruction_regexp.cap(1).toLower()];
-        return false;
+        if(frame->type != StackFrame::FRAME_CALL)
+            continue;
+
+        if(++depth <= MAX_BACKTRACE)
+            entries.append({frame->value, functionAt(frame->value)});
     }
-    else
-        throw SteveInterpreterException{QObject::trUtf8("Ich kenne die Anweisung %1 nicht.").arg(instruction_regexp.cap(1)), current_line, instruction_regexp.cap(1)};
+
+    return entries;
 }
 
-void SteveInterpreter::executeLine() throw (SteveInterpreterException)
+bool SteveInterpreter::executeLineUnchecked()
 {
     if(!code_valid)
-        throw SteveInterpreterException{QObject::trUtf8("Der Code enthält Fehler."), 0};
+    {
+        fail(ERROR_CODE_INVALID);
+        run.error.line = 0;
+        return false;
+    }
 
-    hit_breakpoint = false;
+    run.hit_breakpoint = false;
 
-    if(current_line >= code.size())
+    if(run.current_line >= program->code.size())
     {
-        execution_finished = true;
-        return;
+        run.execution_finished = true;
+        run.statistics.time_ms = run.timer.elapsed();
+        return true;
     }
 
-    QStringList &line = token[current_line];
-    if(line.size() == 0 || code[current_line].isEmpty() || isComment(line[0]))
+    const TokenLine line = program->line(run.current_line);
+    if(line.size() == 0 || program->code[run.current_line].isEmpty() || isComment(line[0]))
     {
-        current_line++;
-        return;
+        run.current_line++;
+        return true;
     }
 
-    //TODO: Backtrace?
+    if(!countLine())
+        return false;
+
     const int MAX_STACK_SIZE = 500000;
-    if(loop_count.size() > MAX_STACK_SIZE ||
-            stack.size() > MAX_STACK_SIZE)
-        throw SteveInterpreterException(QObject::trUtf8("Der Stack wird langsam ein bisschen zu groß.."), current_line);
+    if(run.frames.size() > MAX_STACK_SIZE)
+        return fail(ERROR_STACK_OVERFLOW);
+
+    bool handled;
+    if(!executeCompiled(handled))
+        return false;
+    else if(handled)
+        return true;
 
-    KEYWORD keyword = getKeyword(line[0]);
+    KEYWORD keyword = keywordAt(line, 0);
 
     if(keyword != -1)
     {
         if(keyword != KEYWORD_REPEAT)
-            coming_from_repeat_end = false;
+            run.coming_from_repeat_end = false;
         if(keyword != KEYWORD_IF && keyword != KEYWORD_REPEAT && keyword != KEYWORD_WHILE)
-            coming_from_condition = false;
+            run.coming_from_condition = false;
 
         switch(keyword)
         {
         case KEYWORD_IF:
         {
-            if(!(line.size() == 3 && match(line[2], KEYWORD_THEN)) && !(line.size() == 4 && match(line[1], KEYWORD_NOT) && match(line[3], KEYWORD_THEN)))
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1 [%2] [bedingung] %3").arg(str(KEYWORD_IF)).arg(str(KEYWORD_NOT)).arg(str(KEYWORD_THEN)), current_line);
+            if(!(line.size() == 3 && isToken(line, 2, KEYWORD_THEN)) && !(line.size() == 4 && isToken(line, 1, KEYWORD_NOT) && isToken(line, 3, KEYWORD_THEN)))
+                return fail(ERROR_SYNTAX_IF);
 
             bool result;
             bool inverted = line.size() == 4;
 
-            if(coming_from_condition)
+            if(run.coming_from_condition)
             {
-                result = custom_condition_return_stack.pop();
-                coming_from_condition = false;
+                result = run.condition_result;
+                run.coming_from_condition = false;
             }
             else
             {
                 //If not handled, it means current_line is set to the beginning of a custom condition
-                if(!handleCondition(inverted ? line[2] : line[1], result))
-                    return;
+                CALL_RESULT call_result = handleCondition(inverted ? line[2] : line[1], result);
+                if(call_result != CALL_DONE)
+                    return call_result == CALL_JUMPED;
             }
 
             if(inverted)
                 result = !result;
 
-            enter_else = !result;
+            run.enter_else = !result;
             if(result)
-                current_line++;
+                run.current_line++;
             else //Go to ELSE or IF_END
-                current_line = branches[current_line];
+                run.current_line = program->branches[run.current_line];
 
-            return;
+            return true;
         }
         case KEYWORD_ELSE:
             if(line.size() != 1)
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1").arg(str(KEYWORD_ELSE)), current_line);
+                return fail(ERROR_SYNTAX_KEYWORD, str(KEYWORD_ELSE));
 
-            if(enter_else)
+            if(run.enter_else)
             {
-                enter_else = false;
-                current_line++;
+                run.enter_else = false;
+                run.current_line++;
             }
             else
             {
                 //Go to IF_END
-                current_line = branches[current_line];
+                run.current_line = program->branches[run.current_line];
             }
-            return;
+            return true;
         case KEYWORD_IF_END:
             if(line.size() != 1)
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1").arg(str(KEYWORD_IF_END)), current_line);
+                return fail(ERROR_SYNTAX_KEYWORD, str(KEYWORD_IF_END));
 
-            current_line++;
-            return;
+            run.current_line++;
+            return true;
 
         case KEYWORD_REPEAT:
         {
             bool repeat_no_condition = line.size() == 1;
-            bool repeat_always = line.size() == 2 && match(line[1], COND_ALWAYS);
-            bool repeat_count = line.size() == 3 && match(line[2], KEYWORD_TIMES);
-            bool repeat_condition = (line.size() == 3 && match(line[1], KEYWORD_WHILE)) || (line.size() == 4 && match(line[1], KEYWORD_WHILE) && match(line[2], KEYWORD_NOT));
+            bool repeat_always = line.size() == 2 && isToken(line, 1, COND_ALWAYS);
+            bool repeat_count = line.size() == 3 && isToken(line, 2, KEYWORD_TIMES);
+            bool repeat_condition = (line.size() == 3 && isToken(line, 1, KEYWORD_WHILE)) || (line.size() == 4 && isToken(line, 1, KEYWORD_WHILE) && isToken(line, 2, KEYWORD_NOT));
             bool inverted = line.size() == 4;
 
             //None of the above
             if(!(repeat_no_condition || repeat_always || repeat_count || repeat_condition))
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1\n%1 [zahl] %2\n%1 %3 [%4] [bedingung]\n%1 %5").arg(str(KEYWORD_REPEAT)).arg(str(KEYWORD_TIMES))
-                                                .arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT)).arg(str(COND_ALWAYS)), current_line);
+                return fail(ERROR_SYNTAX_REPEAT);
 
-            if(coming_from_break) //Leave this block, but clean up stack first
+            if(run.coming_from_break) //Leave this block, but clean up stack first
             {
-                coming_from_break = false;
+                run.coming_from_break = false;
 
                 if(repeat_count)
-                    loop_count.pop();
+                    run.frames.pop_back();
 
-                current_line = branches[current_line] + 1;
+                run.current_line = program->branches[run.current_line] + 1;
 
-                return;
+                return true;
             }
 
             if(repeat_always || repeat_no_condition)
-                current_line++;
+                run.current_line++;
 
             else if(repeat_count)
             {
-                if(coming_from_repeat_end)
+                if(run.coming_from_repeat_end)
                 {
-                    loop_count.top()--;
-                    int count = loop_count.top();
+                    int count = --run.frames.back().value;
                     if(count <= 0)
                     {
-                        current_line = branches[current_line] + 1;
-                        loop_count.pop();
+                        run.current_line = program->branches[run.current_line] + 1;
+                        run.frames.pop_back();
                     }
                     else
-                        current_line++;
+                        run.current_line++;
                 }
                 else
                 {
                     bool is_numeric;
                     int count = line[1].toInt(&is_numeric);
                     if(!is_numeric)
-                        throw SteveInterpreterException(QObject::trUtf8("%1 ist keine Zahl.").arg(line[1]), current_line, line[1]);
+                        return fail(ERROR_NOT_A_NUMBER, line[1], line[1]);
 
                     if(count < 0 || count > 9999)
-                        throw SteveInterpreterException(QObject::trUtf8("Die Zahl muss >= 0 und kleiner als 10000 sein."), current_line, line[1]);
+                        return fail(ERROR_COUNT_RANGE, QString(), line[1]);
                     else if(count == 0)
                     {
-                        current_line = branches[current_line] + 1;
-                        return;
+                        run.current_line = program->branches[run.current_line] + 1;
+                        return true;
                     }
                     else
                     {
-                        loop_count.push(count);
-                        current_line++;
+                        run.frames.push_back({StackFrame::FRAME_LOOP, false, count});
+                        run.current_line++;
                     }
                 }
             }
             else //if(repeat_condition)
             {
-                coming_from_repeat_end = false; //Slight hack
+                run.coming_from_repeat_end = false; //Slight hack
 
                 bool result;
-                if(coming_from_condition)
+                if(run.coming_from_condition)
                 {
-                    result = custom_condition_return_stack.pop();
-                    coming_from_condition = false;
+                    result = run.condition_result;
+                    run.coming_from_condition = false;
                 }
                 else
                 {
                     //If not handled, it means current_line is set to the beginning of a custom condition
-                    if(!handleCondition(inverted ? line[3] : line[2], result))
-                        return;
+                    CALL_RESULT call_result = handleCondition(inverted ? line[3] : line[2], result);
+                    if(call_result != CALL_DONE)
+                        return call_result == CALL_JUMPED;
                 }
 
                 if(result != inverted)
-                    current_line++;
+                    run.current_line++;
                 else
-                    current_line = branches[current_line] + 1;
+                    run.current_line = program->branches[run.current_line] + 1;
             }
 
-            coming_from_repeat_end = false;
-            return;
+            run.coming_from_repeat_end = false;
+            return true;
         }
         case KEYWORD_REPEAT_END:
         {
             //Condition here instead of at the beginning: DO...WHILE
             if(line.size() == 3 || line.size() == 4)
             {
-                if(!match(line[1], KEYWORD_WHILE) || (line.size() == 4 && !match(line[2], KEYWORD_NOT)))
-                    throw SteveInterpreterException(QObject::trUtf8("Syntax: %1 %2 [%3] [bedingung]").arg(str(KEYWORD_REPEAT_END)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT)), current_line);
+                if(!isToken(line, 1, KEYWORD_WHILE) || (line.size() == 4 && !isToken(line, 2, KEYWORD_NOT)))
+                    return fail(ERROR_SYNTAX_REPEAT_END_CONDITION);
 
                 bool inverted = line.size() == 4;
 
                 bool result;
-                if(coming_from_condition)
+                if(run.coming_from_condition)
                 {
-                    result = custom_condition_return_stack.pop();
-                    coming_from_condition = false;
+                    result = run.condition_result;
+                    run.coming_from_condition = false;
                 }
                 else
                 {
                     //If not handled, it means current_line is set to the beginning of a custom condition
-                    if(!handleCondition(inverted ? line[3] : line[2], result))
-                        return;
+                    CALL_RESULT call_result = handleCondition(inverted ? line[3] : line[2], result);
+                    if(call_result != CALL_DONE)
+                        return call_result == CALL_JUMPED;
                 }
 
                 if(result != inverted)
-                    current_line = branches[current_line];
+                    run.current_line = program->branches[run.current_line];
                 else
-                    current_line++;
+                    run.current_line++;
 
-                return;
+                return true;
             }
             //No condition here: WHILE...DO
             else if(line.size() == 1)
             {
-                current_line = branches[current_line];
-                coming_from_repeat_end = true;
-                return;
+                run.current_line = program->branches[run.current_line];
+                run.coming_from_repeat_end = true;
+                return true;
             }
             else
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1\n%1 %2 [%3] [bedingung]").arg(str(KEYWORD_REPEAT_END)).arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT)), current_line);
-
-            return;
+                return fail(ERROR_SYNTAX_REPEAT_END);
         }
 
         case KEYWORD_WHILE:
         {
             if(!(line.size() == 2) &&
-                    !(line.size() == 3 && match(line[1], KEYWORD_NOT)))
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1 [%2] [bedingung]").arg(str(KEYWORD_WHILE)).arg(str(KEYWORD_NOT)), current_line);
+                    !(line.size() == 3 && isToken(line, 1, KEYWORD_NOT)))
+                return fail(ERROR_SYNTAX_WHILE);
 
             bool inverted = line.size() == 3;
 
             bool result;
-            if(coming_from_condition)
+            if(run.coming_from_condition)
             {
-                result = custom_condition_return_stack.pop();
-                coming_from_condition = false;
+                result = run.condition_result;
+                run.coming_from_condition = false;
             }
             else
             {
-                if(!handleCondition(inverted ? line[2] : line[1], result))
-                    return;
+                CALL_RESULT call_result = handleCondition(inverted ? line[2] : line[1], result);
+                if(call_result != CALL_DONE)
+                    return call_result == CALL_JUMPED;
             }
 
             if(result != inverted)
-                current_line++;
+                run.current_line++;
             else
-                current_line = branches[current_line] + 1;
+                run.current_line = program->branches[run.current_line] + 1;
 
-            return;
+            return true;
         }
         case KEYWORD_WHILE_END:
             if(line.size() != 1)
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1").arg(str(KEYWORD_WHILE_END)), current_line);
+                return fail(ERROR_SYNTAX_KEYWORD, str(KEYWORD_WHILE_END));
 
-            current_line = branches[current_line];
-            return;
+            run.current_line = program->branches[run.current_line];
+            return true;
 
         case KEYWORD_NEW_INSTR:
         case KEYWORD_NEW_COND:
-            if(enter_sub)
+            if(run.enter_sub)
             {
                 //True is default
                 if(keyword == KEYWORD_NEW_COND)
-                    custom_condition_return_stack.push(true);
+                {
+                    StackFrame *frame = callFrame();
+                    if(!frame)
+                        return false;
+
+                    frame->result = true;
+                }
 
-                enter_sub = false;
-                current_line++;
+                run.enter_sub = false;
+                run.current_line++;
             }
             else
-                current_line = branches[current_line] + 1;
+                run.current_line = program->branches[run.current_line] + 1;
 
-            return;
+            return true;
         case KEYWORD_NEW_INSTR_END:
-            current_line = stack.pop() + 1;
-            return;
+        {
+            StackFrame frame;
+            if(!popCall(frame))
+                return false;
+
+            run.current_line = frame.value + 1;
+            return true;
+        }
         case KEYWORD_NEW_COND_END:
-            coming_from_condition = true;
-            current_line = stack.pop();
-            if(custom_condition_return_stack.size() == 0)
-                throw SteveInterpreterException(QObject::trUtf8("WTF #9"), current_line);
+        {
+            StackFrame frame;
+            if(!popCall(frame))
+                return false;
+
+            run.coming_from_condition = true;
+            run.condition_result = frame.result;
+            run.current_line = frame.value;
 
-            return;
+            return true;
+        }
 
         case KEYWORD_CONTINUE:
             if(line.size() != 1)
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1").arg(str(keyword)), current_line);
+                return fail(ERROR_SYNTAX_KEYWORD, str(keyword));
 
-            current_line = branches[current_line]; //Jump to end of block (WHILE, REPEAT)
-            return;
+            run.current_line = program->branches[run.current_line]; //Jump to end of block (WHILE, REPEAT)
+            return true;
         case KEYWORD_BREAK:
             if(line.size() != 1)
-                throw SteveInterpreterException(QObject::trUtf8("Syntax: %1").arg(str(keyword)), current_line);
+                return fail(ERROR_SYNTAX_KEYWORD, str(keyword));
 
-            current_line = branches[current_line];
+            run.current_line = program->branches[run.current_line];
 
-            //REPEAT uses loop_count, could lead to stack overflow
-            if(getKeyword(token[current_line][0]) == KEYWORD_REPEAT_END)
+            //REPEAT has a frame, could lead to stack overflow
+            if(keywordAt(program->line(run.current_line), 0) == KEYWORD_REPEAT_END)
             {
-                current_line = branches[current_line]; //Jump to beginning
-                coming_from_break = true;
+                run.current_line = program->branches[run.current_line]; //Jump to beginning
+                run.coming_from_break = true;
             }
             else
-                current_line++; //Skip line
+                run.current_line++; //Skip line
 
-            return;
+            return true;
         default:
-            throw SteveInterpreterException(QObject::trUtf8("%1 macht hier keinen Sinn.").arg(line[0]), current_line);
+            return fail(ERROR_NO_SENSE, line[0]);
         }
     }
 
     if(line.size() != 1)
-        throw SteveInterpreterException(QObject::trUtf8("Ungültige Anweisung."), current_line);
+        return fail(ERROR_INVALID_INSTRUCTION);
 
-    if(handleInstruction(line[0]))
-        current_line++;
+    CALL_RESULT result = handleInstruction(line[0]);
+    if(result == CALL_DONE)
+        run.current_line++;
 
-    return;
+    return result != CALL_FAILED;
+}
 
-    //Never called, handleInstruction throws it for us.
-    //throw SteveInterpreterException(QObject::trUtf8("Ich hab` keine Ahnung, was %1 bedeutet :-(").arg(code[current_line]), current_line);
+quint64 SteveInterpreter::getStateHash() const
+{
+    const quint64 flags = run.coming_from_condition | run.coming_from_repeat_end << 1 | run.coming_from_break << 2 | run.enter_sub << 3
+            | run.enter_else << 4 | run.execution_finished << 5 | run.condition_result << 6;
+
+    quint64 hash = World::mixHash(world->getHash() ^ (static_cast<quint64>(static_cast<quint32>(run.current_line)) << 8 | flags));
+    for(const StackFrame &frame : run.frames)
+        hash = World::mixHash(hash ^ (static_cast<quint64>(static_cast<quint32>(frame.value)) << 8 | frame.type << 1 | frame.result));
+
+    return hash;
+}
+
+//Brent's cycle detection: Compares with the state saved at the last power of two, constant memory
+bool SteveInterpreter::checkLoop()
+{
+    const quint64 hash = getStateHash();
+    if(run.loop_hash_valid && hash == run.loop_hash)
+        return fail(ERROR_ENDLESS_LOOP);
+
+    if(++run.loop_length == run.loop_power)
+    {
+        run.loop_hash = hash;
+        run.loop_hash_valid = true;
+        run.loop_power *= 2;
+        run.loop_length = 0;
+    }
+
+    return true;
+}
+
+void SteveInterpreter::setWorld(World *world)
+{
+    this->world = world;
+    plain_world = world && typeid(*world) == typeid(World);
 }
 
 int SteveInterpreter::getLine()
 {
-    return current_line;
+    return run.current_line;
 }
 
 void SteveInterpreter::dumpCode()
 {
-    for(int line = 0; line < code.size(); line++)
+    for(int line = 0; line < program->code.size(); line++)
     {
-        if(line == current_line)
+        if(line == run.current_line)
             std::cout << '>';
         else
             std::cout << ' ';
 
-        std::cout << line << ": " << code[line].toStdString();
-        if(branches.contains(line))
-            std::cout << " (" << branches[line] << ")";
+        std::cout << line << ": " << program->code[line].toStdString();
+        if(program->branches[line] != -1)
+            std::cout << " (" << program->branches[line] << ")";
 
         std::cout << std::endl;
     }
     std::cout << std::endl;
 
     std::cout << QObject::trUtf8("Bedingungen: ").toStdString() << std::endl;
-    if(custom_conditions.size() == 0)
+    if(program->custom_conditions.size() == 0)
         std::cout << QObject::trUtf8("(keine)").toStdString() << std::endl;
     else
-        for(auto i : custom_conditions.keys())
-            std::cout << QObject::trUtf8("%1 in Zeile %2").arg(i).arg(custom_conditions[i]).toStdString() << std::endl;
+        for(auto i : program->custom_conditions.keys())
+            std::cout << QObject::trUtf8("%1 in Zeile %2").arg(i).arg(program->custom_conditions[i]).toStdString() << std::endl;
 
     std::cout << std::endl;
 
     std::cout << QObject::trUtf8("Anweisungen: ").toStdString() << std::endl;
-    if(custom_instructions.size() == 0)
+    if(program->custom_instructions.size() == 0)
         std::cout << QObject::trUtf8("(keine)").toStdString() << std::endl;
     else
-        for(auto i : custom_instructions.keys())
-            std::cout << QObject::trUtf8("%1 in Zeile %2").arg(i).arg(custom_instructions[i]).toStdString() << std::endl;
+        for(auto i : program->custom_instructions.keys())
+            std::cout << QObject::trUtf8("%1 in Zeile %2").arg(i).arg(program->custom_instructions[i]).toStdString() << std::endl;
 
     std::cout << QObject::trUtf8("Status: ").toStdString() << std::endl;
-    if(enter_else)
+    if(run.enter_else)
         std::cout << QObject::trUtf8("Ich würde den nächsten %1-Block betreten.").arg(str(KEYWORD_ELSE)).toStdString() << std::endl;
-    if(enter_sub)
+    if(run.enter_sub)
         std::cout << QObject::trUtf8("Ich würde den nächsten %1- und %2-Block betreten.").arg(str(KEYWORD_NEW_INSTR)).arg(str(KEYWORD_NEW_COND)).toStdString() << std::endl;
-    if(coming_from_repeat_end)
+    if(run.coming_from_repeat_end)
         std::cout << QObject::trUtf8("Ich komme gerade von %1.").arg(str(KEYWORD_REPEAT_END)).toStdString() << std::endl;
-    if(coming_from_condition)
-        std::cout << QObject::trUtf8("Ich komme gerade von einer selbstdefinierten Bedingung. Der Wert ist %1").arg(custom_condition_return_stack.top() ? "WAHR" : "FALSCH" ).toStdString() << std::endl;
+    if(run.coming_from_condition)
+        std::cout << QObject::trUtf8("Ich komme gerade von einer selbstdefinierten Bedingung. Der Wert ist %1").arg(run.condition_result ? "WAHR" : "FALSCH" ).toStdString() << std::endl;
     if(executionFinished())
         std::cout << QObject::trUtf8("Das Programm ist zuende.").toStdString() << std::endl;
 }
 
-//Conditions
-bool SteveInterpreter::condAlways(World *world, bool has_param, int param)
-{
-    Q_UNUSED(world);
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return true;
-}
-
-bool SteveInterpreter::isWall(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return world->frontBlocked();
-}
-
-bool SteveInterpreter::isCube(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return world->isCube();
-}
-
-bool SteveInterpreter::isBrick(World *world, bool has_param, int param)
-{
-    if(!has_param)
-        return world->getStackSize() > 0;
-
-    return world->getStackSize() == static_cast<unsigned int>(param);
-}
-
-bool SteveInterpreter::isMarked(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return world->isMarked();
-}
-
-bool SteveInterpreter::isNorth(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return world->getOrientation() == ORIENT_NORTH;
-}
-
-bool SteveInterpreter::isEast(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return world->getOrientation() == ORIENT_EAST;
-}
-
-bool SteveInterpreter::isSouth(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return world->getOrientation() == ORIENT_SOUTH;
-}
-
-bool SteveInterpreter::isWest(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    return world->getOrientation() == ORIENT_WEST;
-}
-
-//Instructions
-bool SteveInterpreter::unmark(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    world->setMark(false);
-    return true;
-}
-
-bool SteveInterpreter::mark(World *world, bool has_param, int param)
-{
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    world->setMark(true);
-    return true;
-}
-
-bool SteveInterpreter::pickup(World *world, bool has_param, int param)
-{
-    if(!has_param)
-        param = 1;
-
-    if(world->isWall())
-        throw SteveInterpreterException(QObject::trUtf8("Steve steht vor einer Wand und weiß nicht, was er jetzt tun soll."), current_line);
-
-    if(!world->pickup(param))
-        throw SteveInterpreterException(QObject::trUtf8("Steve sieht nicht genug Ziegel zum Aufheben."), current_line);
-
-    return true;
-}
-
-bool SteveInterpreter::deposit(World *world, bool has_param, int param)
-{
-    if(!has_param)
-        param = 1;
-
-    if(world->isWall())
-        throw SteveInterpreterException(QObject::trUtf8("Steve steht vor einer Wand und weiß nicht, was er jetzt tun soll."), current_line);
-
-    if(!world->deposit(param))
-        throw SteveInterpreterException(QObject::trUtf8("Maximale Höhe erreicht.\nSteve kann nicht höher heben, er hat einen Bandscheibenvorfall."), current_line);
-
-    return true;
-}
-
-bool SteveInterpreter::turnRight(World *world, bool has_param, int param)
-{
-    if(!has_param)
-        param = 1;
-
-    world->turnRight(param);
-    return true;
-}
-
-bool SteveInterpreter::turnLeft(World *world, bool has_param, int param)
-{
-    if(!has_param)
-        param = 1;
-
-    world->turnLeft(param);
-    return true;
-}
-
-bool SteveInterpreter::step(World *world, bool has_param, int param)
-{
-    if(!has_param)
-        param = 1;
-
-    while(param--)
-        if(!world->stepForward())
-            throw SteveInterpreterException(QObject::trUtf8("Steve war so dumm und ist gegen die Wand gelaufen!"), current_line);
-
-    return true;
-}
-
-bool SteveInterpreter::breakpoint(World *world, bool has_param, int param)
-{
-    Q_UNUSED(world);
-    Q_UNUSED(has_param);
-    Q_UNUSED(param);
-
-    hit_breakpoint = true;
-    return true;
-}
-
 //Other private functions
-SteveInterpreter::KEYWORD SteveInterpreter::getKeyword(QString string) const
+SteveInterpreter::KEYWORD SteveInterpreter::getKeyword(const QString &string)
 {
-    for(auto i : keywords.keys())
-    {
-        if(match(string, i))
-            return i;
-    }
-
-    return static_cast<SteveInterpreter::KEYWORD>(-1);
+    return language().keyword_lookup.value(string.toLower(), KEYWORD_INVALID);
 }
 
-SteveInterpreter::INSTRUCTION SteveInterpreter::getInstruction(QString string) const
+SteveInterpreter::INSTRUCTION SteveInterpreter::getInstruction(const QString &string)
 {
-    for(auto i : instructions.keys())
-    {
-        if(match(string, i))
-            return i;
-    }
-
-    return static_cast<SteveInterpreter::INSTRUCTION>(-1);
+    return language().instruction_lookup.value(string.toLower(), INSTR_INVALID);
 }
 
-SteveInterpreter::CONDITION SteveInterpreter::getCondition(QString string) const
+SteveInterpreter::CONDITION SteveInterpreter::getCondition(const QString &string)
 {
-    for(auto i : conditions.keys())
-    {
-        if(match(string, i))
-            return i;
-    }
-
-    return static_cast<SteveInterpreter::CONDITION>(-1);
+    return language().condition_lookup.value(string.toLower(), COND_INVALID);
 }
 
 bool SteveInterpreter::isComment(const QString &s)
@@ -985,25 +1647,19 @@ bool SteveInterpreter::isComment(const QString &s)
     return s.startsWith(";") || s.startsWith("#") || s.startsWith("//");
 }
 
-template <typename TOKEN>
-bool SteveInterpreter::match(const QString &str, const TOKEN tok) const
+const QString SteveInterpreter::str(KEYWORD keyword)
 {
-    return str.compare(this->str(tok), Qt::CaseInsensitive) == 0;
+    return language().keywords.value(keyword);
 }
 
-const QString SteveInterpreter::str(KEYWORD keyword) const
+const QString SteveInterpreter::str(INSTRUCTION instr)
 {
-    return keywords[keyword];
+    return language().instructions.value(instr);
 }
 
-const QString SteveInterpreter::str(INSTRUCTION instr) const
+const QString SteveInterpreter::str(CONDITION cond)
 {
-    return instructions[instr];
-}
-
-const QString SteveInterpreter::str(CONDITION cond) const
-{
-    return conditions[cond];
+    return language().conditions.value(cond);
 }
 
 //Structure chart generation
@@ -1043,9 +1699,9 @@ void SteveInterpreter::drawText(int x, int y, QPainter &painter, const QString &
 
         if(getKeyword(t) != -1)
             painter.setPen(QColor(0, 128, 0));
-        else if(getCondition(t) != -1 || custom_conditions.contains(t.toLower()))
+        else if(getCondition(t) != -1 || program->custom_conditions.contains(t.toLower()))
             painter.setPen(QColor(192,16, 112));
-        else if(getInstruction(t) != -1 || custom_instructions.contains(t.toLower()))
+        else if(getInstruction(t) != -1 || program->custom_instructions.contains(t.toLower()))
             painter.setPen(QColor(128, 0, 0));
         else
         {
@@ -1080,7 +1736,7 @@ int SteveInterpreter::textWidth(const QString &text)
     for(const QString &tok : token)
     {
         QFontMetrics *metrics = &metrics_bold;
-        if(getKeyword(tok) == -1 && getCondition(tok) == -1 && getInstruction(tok) == -1 && !custom_conditions.contains(tok.toLower()) && !custom_instructions.contains(tok.toLower()))
+        if(getKeyword(tok) == -1 && getCondition(tok) == -1 && getInstruction(tok) == -1 && !program->custom_conditions.contains(tok.toLower()) && !program->custom_instructions.contains(tok.toLower()))
             metrics = &metrics_normal;
 
         width += metrics->width(tok) + metrics->width(' ');
@@ -1098,7 +1754,7 @@ int SteveInterpreter::textHeight()
     return metrics_normal.height() + 2;
 }
 
-QPixmap SteveInterpreter::structureChart() throw (SteveInterpreterException)
+QPixmap SteveInterpreter::structureChart()
 {
     if(!code_valid)
         throw SteveInterpreterException(QObject::trUtf8("Der Code enthält Fehler."), 0);
@@ -1107,18 +1763,18 @@ QPixmap SteveInterpreter::structureChart() throw (SteveInterpreterException)
 
     QVector<StructureBlock> blocks;
     QVector<QPixmap> pixmaps;
-    blocks.resize(1 + custom_instructions.size() + custom_conditions.size());
+    blocks.resize(1 + program->custom_instructions.size() + program->custom_conditions.size());
 
     blocks[0].title = QObject::trUtf8("Hauptprogramm");
 
     //Main block
     int current_block = 0, last_block = 0;
-    for(line = 0; line < code.size(); line++)
+    for(line = 0; line < program->code.size(); line++)
     {
-        if(token[line].size() < 1)
+        if(program->line(line).size() < 1)
             continue;
 
-        KEYWORD keyword = getKeyword(token[line][0]);
+        KEYWORD keyword = keywordAt(program->line(line), 0);
         switch(keyword)
         {
         case KEYWORD_NEW_COND_END:
@@ -1127,14 +1783,14 @@ QPixmap SteveInterpreter::structureChart() throw (SteveInterpreterException)
             break;
         case KEYWORD_NEW_COND:
             current_block = ++last_block;
-            blocks[current_block].title = QObject::trUtf8("Bedingung %0").arg(custom_conditions.key(line, "WTF #10"));
+            blocks[current_block].title = QObject::trUtf8("Bedingung %0").arg(program->custom_conditions.key(line, "WTF #10"));
             break;
         case KEYWORD_NEW_INSTR:
             current_block = ++last_block;
-            blocks[current_block].title = QObject::trUtf8("Anweisung %0").arg(custom_instructions.key(line, "WTF #11"));
+            blocks[current_block].title = QObject::trUtf8("Anweisung %0").arg(program->custom_instructions.key(line, "WTF #11"));
             break;
         default:
-            blocks[current_block].code.append(code[line].trimmed());
+            blocks[current_block].code.append(program->code[line].trimmed());
             blocks[current_block].code_lines.append(line);
         }
     }
@@ -1201,10 +1857,10 @@ QPixmap SteveInterpreter::structureChartBlock(const StructureBlock &sb)
     for(int line = 0; line < sb.code.size(); line++)
     {
         int actual_line = sb.code_lines[line];
-        if(token[actual_line].size() < 1)
+        if(program->line(actual_line).size() < 1)
             continue;
 
-        KEYWORD keyword = getKeyword(token[actual_line][0]);
+        KEYWORD keyword = keywordAt(program->line(actual_line), 0);
         StructureBlock child_block;
 
         //TODO: This works, but is ugly code
@@ -1212,16 +1868,16 @@ QPixmap SteveInterpreter::structureChartBlock(const StructureBlock &sb)
         {
             int child_start = line;
             int actual_if_start = actual_line;
-            while(actual_line < branches[actual_if_start])
+            while(actual_line < program->branches[actual_if_start])
             {
                 child_block.code.append(sb.code[line]);
                 child_block.code_lines.append(sb.code_lines[line]);
                 actual_line = sb.code_lines[++line];
             }
-            if(match(token[actual_line][0], KEYWORD_ELSE))
+            if(isToken(program->line(actual_line), 0, KEYWORD_ELSE))
             {
                 actual_if_start = actual_line;
-                while(actual_line < branches[actual_if_start])
+                while(actual_line < program->branches[actual_if_start])
                 {
                     child_block.code.append(sb.code[line]);
                     child_block.code_lines.append(sb.code_lines[line]);
@@ -1242,7 +1898,7 @@ QPixmap SteveInterpreter::structureChartBlock(const StructureBlock &sb)
         {
             int child_start = line;
             int actual_block_start = actual_line;
-            while(actual_line < branches[actual_block_start])
+            while(actual_line < program->branches[actual_block_start])
             {
                 child_block.code.append(sb.code[line]);
                 child_block.code_lines.append(sb.code_lines[line]);
@@ -1276,10 +1932,10 @@ QPixmap SteveInterpreter::structureChartBlock(const StructureBlock &sb)
     for(int line = 0; line < sb.code.size(); line++)
     {
         int actual_line = sb.code_lines[line];
-        if(token[actual_line].size() < 1)
+        if(program->line(actual_line).size() < 1)
             continue;
 
-        KEYWORD keyword = getKeyword(token[actual_line][0]);
+        KEYWORD keyword = keywordAt(program->line(actual_line), 0);
         if(keyword == KEYWORD_IF || keyword == KEYWORD_REPEAT || keyword == KEYWORD_WHILE)
         {
             painter.drawPixmap(2, current_y, child_pixmaps[line]);
@@ -1300,26 +1956,26 @@ QPixmap SteveInterpreter::structureChartBlock(const StructureBlock &sb)
 
 QPixmap SteveInterpreter::structureChartIfBlock(const StructureBlock &sb)
 {
-    Q_ASSERT(match(token[sb.code_lines[0]][0], KEYWORD_IF));
+    Q_ASSERT(isToken(program->line(sb.code_lines[0]), 0, KEYWORD_IF));
 
     StructureBlock if_true_block, if_false_block;
 
     int line = 0, actual_if_line = sb.code_lines[line];
     int actual_line = sb.code_lines[++line];
-    while(actual_line < branches[actual_if_line])
+    while(actual_line < program->branches[actual_if_line])
     {
         if_true_block.code_lines.append(actual_line);
         if_true_block.code.append(sb.code[line]);
         actual_line = sb.code_lines[++line];
     }
-    if(match(token[actual_line][0], KEYWORD_ELSE))
+    if(isToken(program->line(actual_line), 0, KEYWORD_ELSE))
     {
         //This line with "else" as new start
         actual_if_line = actual_line;
 
         line += 1;
         actual_line = sb.code_lines[line];
-        while(actual_line < branches[actual_if_line])
+        while(actual_line < program->branches[actual_if_line])
         {
             if_false_block.code_lines.append(actual_line);
             if_false_block.code.append(sb.code[line]);
@@ -1370,13 +2026,13 @@ QPixmap SteveInterpreter::structureChartIfBlock(const StructureBlock &sb)
 
 QPixmap SteveInterpreter::structureChartOtherBlock(const StructureBlock &sb)
 {
-    Q_ASSERT(match(token[sb.code_lines[0]][0], KEYWORD_REPEAT) || match(token[sb.code_lines[0]][0], KEYWORD_WHILE));
+    Q_ASSERT(isToken(program->line(sb.code_lines[0]), 0, KEYWORD_REPEAT) || isToken(program->line(sb.code_lines[0]), 0, KEYWORD_WHILE));
 
     StructureBlock this_block;
 
     int line = 0, actual_start_line = sb.code_lines[line];
     int actual_line = sb.code_lines[++line];
-    while(actual_line < branches[actual_start_line])
+    while(actual_line < program->branches[actual_start_line])
     {
         this_block.code_lines.append(actual_line);
         this_block.code.append(sb.code[line]);
@@ -1416,5 +2072,22 @@ QPixmap SteveInterpreter::structureChartOtherBlock(const StructureBlock &sb)
 //SteveInterpreterException
 QString SteveInterpreterException::message()
 {
-    return QObject::trUtf8("Fehler in Zeile %1:\n%2").arg(line).arg(error);
+    return QObject::trUtf8("Fehler in Zeile %1:\n%2").arg(line + 1).arg(error);
+}
+
+QString SteveInterpreterException::backtraceText() const
+{
+    QString text;
+    for(const BacktraceEntry &entry : backtrace)
+    {
+        if(entry.function.isEmpty())
+            text += QObject::trUtf8("Zeile %1 im Hauptprogramm\n").arg(entry.line + 1);
+        else
+            text += QObject::trUtf8("Zeile %1 in %2\n").arg(entry.line + 1).arg(entry.function);
+    }
+
+    if(backtrace_depth > backtrace.size())
+        text += QObject::trUtf8("(%1 weitere)\n").arg(backtrace_depth - backtrace.size());
+
+    return text;
 }
@@ -2,21 +2,31 @@
 #define STEVEINTERPRETER_H
 
 #include <exception>
+#include <memory>
+#include <vector>
+#include <QByteArray>
 #include <QString>
 #include <QStringList>
-#include <QMap>
 #include <QHash>
-#include <QStack>
+#include <QVector>
 #include <QPixmap>
+#include <QElapsedTimer>
 
 #include "world.h"
 
 class SteveInterpreter;
 
+//A line in the backtrace of an error
+struct BacktraceEntry {
+    int line;
+    QString function; //Custom instruction or condition the line is in, empty for the main program
+};
+
 class SteveInterpreterException : public std::exception {
 public:
     SteveInterpreterException(const QString &error, int line) : SteveInterpreterException(error, line, "") {}
-    SteveInterpreterException(const QString &error, int line, const QString &affected) : error(error), line(line), affected(affected) {}
+    //affected is copied, it can point into the tokens of a SteveProgram
+    SteveInterpreterException(const QString &error, int line, const QString &affected) : error(error), line(line), affected(affected.constData(), affected.size()) {}
     ~SteveInterpreterException() throw() {}
 
     const QString &getAffected() { return affected; }
@@ -24,35 +34,152 @@ public:
 
     QString message();
 
+    //Innermost first, starting with the line of the error. Empty if thrown outside of execution.
+    void setBacktrace(const QVector<BacktraceEntry> &backtrace, int depth) { this->backtrace = backtrace; backtrace_depth = depth; }
+    const QVector<BacktraceEntry> &getBacktrace() const { return backtrace; }
+    int getBacktraceDepth() const { return backtrace_depth; } //Can be more than getBacktrace().size()
+    QString backtraceText() const;
+
 private:
 
     const QString error;
     const int line;
     const QString affected;
+    QVector<BacktraceEntry> backtrace;
+    int backtrace_depth = 0;
+};
+
+//Errors while executing, the message is only built by SteveInterpreter::errorMessage if it's shown
+enum STEVE_ERROR : quint8 {
+    ERROR_NONE,
+    ERROR_CODE_INVALID,
+    ERROR_STACK_OVERFLOW,
+    ERROR_SYNTAX_IF,
+    ERROR_SYNTAX_KEYWORD, //argument: Keyword without anything after it
+    ERROR_SYNTAX_REPEAT,
+    ERROR_SYNTAX_REPEAT_END,
+    ERROR_SYNTAX_REPEAT_END_CONDITION,
+    ERROR_SYNTAX_WHILE,
+    ERROR_NOT_A_NUMBER,
+    ERROR_COUNT_RANGE,
+    ERROR_NO_SENSE,
+    ERROR_INVALID_INSTRUCTION,
+    ERROR_INVALID_CONDITION,
+    ERROR_INSTRUCTION_PARAM,
+    ERROR_CONDITION_PARAM,
+    ERROR_UNKNOWN_INSTRUCTION,
+    ERROR_UNKNOWN_CONDITION,
+    ERROR_FACING_WALL,
+    ERROR_NOT_ENOUGH_BRICKS,
+    ERROR_MAX_HEIGHT,
+    ERROR_WALK_INTO_WALL,
+    ERROR_LIMIT_LINES,
+    ERROR_LIMIT_ACTIONS,
+    ERROR_LIMIT_TIME,
+    ERROR_ENDLESS_LOOP,
+    ERROR_INTERNAL //argument: WTF number
+};
+
+struct SteveError {
+    STEVE_ERROR id = ERROR_NONE;
+    int line = 0;
+    QString argument; //Inserted into the message
+    QString affected; //Part of the line to highlight
 };
 
-typedef bool (SteveInterpreter::*SteveFunctionPtr)(World *world, bool param_given, int param);
+//Limits for a single run, 0 means unlimited
+struct ExecutionBudget {
+    quint64 max_lines = 0;
+    quint64 max_actions = 0;
+    qint64 max_time_ms = 0;
+};
+
+struct ExecutionStatistics {
+    quint64 lines = 0; //Executed lines, without empty lines and comments
+    quint64 actions = 0; //Calls into the world, schritt(3) counts as three
+    qint64 time_ms = 0;
+};
+
+//A word of the code, the text is in SteveProgram::source.
+//Words of the language (which don't overlap) are looked up once while tokenizing.
+struct SourceToken {
+    enum KIND : quint8 {
+        KIND_WORD, //Custom names, calls with a parameter, numbers, comments
+        KIND_KEYWORD,
+        KIND_INSTRUCTION,
+        KIND_CONDITION
+    };
+
+    int offset;
+    int length;
+    KIND kind;
+    int id; //SteveInterpreter::KEYWORD, INSTRUCTION or CONDITION, -1 for KIND_WORD
+};
 
-class SteveFunction {
+//The tokens of one line. The strings aren't copied, they're only valid as long as the program.
+class TokenLine {
 public:
-    //Needed for QHash
-    SteveFunction() : SteveFunction(0, 0, false) {}
-
-    SteveFunction(SteveInterpreter *parent, SteveFunctionPtr function, bool has_param) : parent(parent), function(function), has_param(has_param) {}
-    bool hasParam() const { return has_param; }
-    bool operator() (World *world, int param) const
-    {
-        return (parent->*function)(world, true, param);
-    }
-    bool operator() (World *world) const
-    {
-        return (parent->*function)(world, false, 1);
-    }
+    TokenLine(const QString &source, const SourceToken *tokens, int count) : source(&source), tokens(tokens), count(count) {}
+
+    int size() const { return count; }
+    QString operator[](int i) const { return QString::fromRawData(source->constData() + tokens[i].offset, tokens[i].length); }
+    //-1 if the token isn't of that kind
+    int id(int i, SourceToken::KIND kind) const { return tokens[i].kind == kind ? tokens[i].id : -1; }
 
 private:
-    SteveInterpreter *parent;
-    SteveFunctionPtr function;
-    bool has_param;
+    const QString *source;
+    const SourceToken *tokens;
+    int count;
+};
+
+//A line decoded once by setCode, so executeLine doesn't have to look at the tokens again.
+//Lines that can't be decoded (custom instructions and conditions, blocks, syntax errors) stay TYPE_TOKENS.
+struct CompiledLine {
+    enum TYPE {
+        TYPE_TOKENS, //Interpreted from token
+        TYPE_SKIP, //Empty or comment
+        TYPE_INSTRUCTION, //Built-in instruction which changes the world
+        TYPE_IF, //wenn [nicht] <built-in condition> dann
+        TYPE_WHILE //solange [nicht] <built-in condition>
+    };
+
+    TYPE type = TYPE_TOKENS;
+    int condition = -1; //TYPE_IF and TYPE_WHILE: SteveInterpreter::CONDITION
+    int instruction = -1; //TYPE_INSTRUCTION: SteveInterpreter::INSTRUCTION
+    bool has_param = false;
+    int param = 1;
+    bool inverted = false;
+    int run_end = 0; //First line after this one which is neither TYPE_INSTRUCTION nor TYPE_SKIP
+    bool fused = false; //TYPE_IF and TYPE_WHILE: Block contains only instructions, run it in one go
+    bool tail_call = false; //TYPE_TOKENS: Call of a custom instruction with only *wenn up to *anweisung after it
+};
+
+//Result of SteveInterpreter::setCode. Never changed afterwards, so one parse can be shared by
+//many interpreters, also in different threads (see SteveInterpreter::setProgram).
+struct SteveProgram {
+    QStringList code;
+    //All lines in one string and all tokens in one array, split by simplified() rules
+    QString source;
+    QVector<SourceToken> tokens;
+    QVector<int> line_tokens; //Index of the first token of each line, one more entry for the end
+
+    TokenLine line(int nr) const { return TokenLine{source, tokens.constData() + line_tokens[nr], line_tokens[nr + 1] - line_tokens[nr]}; }
+
+    std::vector<int> branches; //Per line, -1 if the line doesn't start, continue or end a block
+    /* 1: WENN NICHT WAND DANN (3)
+     * 2: SCHRITT
+     * 3: SONST (5)
+     * 4: RECHTSDREHEN
+     * 5: *WENN (1)
+     * branches[1] = 3;
+     * branches[3] = 5;
+     * branches[5] = 1; */
+    QHash<QString, int> custom_instructions, custom_conditions;
+    QVector<CompiledLine> compiled;
+
+    //One space between tokens, comments removed. Line numbers and case are kept (names end up in messages and backtraces),
+    //so two programs with the same normalized code give the same results everywhere.
+    QByteArray normalized() const;
 };
 
 enum BLOCK {
@@ -76,36 +203,41 @@ class SteveInterpreter : public QObject
 public:
     SteveInterpreter(World *world);
 
-    void setCode(QStringList code) throw (SteveInterpreterException);
+    void setCode(QStringList code);
+    //The interpreter itself only holds the state of one run
+    std::shared_ptr<const SteveProgram> getProgram() const { return code_valid ? program : nullptr; }
+    void setProgram(std::shared_ptr<const SteveProgram> program);
     void reset();
-    void executeLine() throw (SteveInterpreterException);
+    void executeLine();
+    //Doesn't throw, returns false and fills error instead
+    bool executeLine(SteveError &error);
+    QString errorMessage(const SteveError &error) const;
+    //Innermost first, from the call frames at the time of the error
+    QVector<BacktraceEntry> errorBacktrace(const SteveError &error, int &depth) const;
     int getLine();
     void dumpCode();
-    void setWorld(World *world) { this->world = world; }
-    bool executionFinished() { return execution_finished; }
-    bool hitBreakpoint() { return hit_breakpoint; }
-    QPixmap structureChart()  throw (SteveInterpreterException);
-
-    //Conditions:
-    bool condAlways(World *world, bool has_param, int param);
-    bool isWall(World *world, bool has_param, int param);
-    bool isCube(World *world, bool has_param, int param);
-    bool isBrick(World *world, bool has_param, int param);
-    bool isMarked(World *world, bool has_param, int param);
-    bool isNorth(World *world, bool has_param, int param);
-    bool isEast(World *world, bool has_param, int param);
-    bool isSouth(World *world, bool has_param, int param);
-    bool isWest(World *world, bool has_param, int param);
-
-    //Instructions:
-    bool step(World *world, bool has_param, int param);
-    bool turnLeft(World *world, bool has_param, int param);
-    bool turnRight(World *world, bool has_param, int param);
-    bool deposit(World *world, bool has_param, int param);
-    bool pickup(World *world, bool has_param, int param);
-    bool mark(World *world, bool has_param, int param);
-    bool unmark(World *world, bool has_param, int param);
-    bool breakpoint(World *world, bool has_param, int param);
+    void setWorld(World *world);
+    bool executionFinished() { return run.execution_finished; }
+    bool hitBreakpoint() { return run.hit_breakpoint; }
+    void setBudget(const ExecutionBudget &budget) { this->budget = budget; }
+    const ExecutionBudget &getBudget() const { return budget; }
+    bool budgetExceeded() const { return run.budget_exceeded; }
+    ExecutionStatistics getStatistics() const;
+    //Executes sequences of instructions and simple blocks in one executeLine() call.
+    //Faster, but the lines in between aren't visible (highlighting, single stepping).
+    void setFusion(bool enabled) { fusion = enabled; }
+    bool isFusion() const { return fusion; }
+    void setProfiling(bool enabled);
+    bool isProfiling() const { return profiling; }
+    //Indexed by line, only filled if profiling is enabled
+    const QVector<quint64> &getLineHits() const { return run.line_hits; }
+    const QVector<quint64> &getLineActions() const { return run.line_actions; }
+    //World, position in the code and the stack. A program which gets into the same state twice never ends.
+    quint64 getStateHash() const;
+    //Fail with ERROR_ENDLESS_LOOP as soon as a state repeats. Costs a getStateHash() per executeLine().
+    void setLoopDetection(bool enabled) { loop_detection = enabled; }
+    bool isLoopDetection() const { return loop_detection; }
+    QPixmap structureChart();
 
     enum KEYWORD {
         KEYWORD_INVALID = -1,
@@ -158,19 +290,76 @@ public:
         COND_WEST
     };
 
-    KEYWORD getKeyword(const QString string) const;
-    INSTRUCTION getInstruction(const QString string) const;
-    CONDITION getCondition(const QString string) const;
-    const QString str(KEYWORD keyword) const;
-    const QString str(INSTRUCTION instr) const;
-    const QString str(CONDITION cond) const;
+    //Case insensitive, -1 if string isn't one
+    static KEYWORD getKeyword(const QString &string);
+    static INSTRUCTION getInstruction(const QString &string);
+    static CONDITION getCondition(const QString &string);
+    static const QString str(KEYWORD keyword);
+    static const QString str(INSTRUCTION instr);
+    static const QString str(CONDITION cond);
 
 private:
-    void findAndThrowMissingBegin(int line, BLOCK block, const QString &affected = "") throw (SteveInterpreterException);
-    bool handleCondition(QString condition_str, bool &result) throw (SteveInterpreterException);
-    bool handleInstruction(QString instruction_str) throw (SteveInterpreterException);
+    //The words of the language, built on first use and shared read-only by all interpreters
+    struct Language {
+        Language();
+
+        QHash<KEYWORD, QString> keywords;
+        QHash<INSTRUCTION, QString> instructions;
+        QHash<CONDITION, QString> conditions;
+        //Lower case word to token
+        QHash<QString, KEYWORD> keyword_lookup;
+        QHash<QString, INSTRUCTION> instruction_lookup;
+        QHash<QString, CONDITION> condition_lookup;
+        //Built-ins handled by executeInstruction and evaluateCondition, true if they take a parameter
+        QHash<INSTRUCTION, bool> instruction_params;
+        QHash<CONDITION, bool> condition_params;
+    };
+
+    static const Language &language();
+
+    //One entry per call of a custom instruction or condition and per counted loop
+    struct StackFrame {
+        enum TYPE : quint8 {
+            FRAME_CALL,
+            FRAME_LOOP
+        };
+
+        TYPE type;
+        bool result; //FRAME_CALL of a custom condition: Set by wahr and falsch
+        int value; //FRAME_CALL: Line of the call, FRAME_LOOP: Remaining iterations
+    };
+
+    enum CALL_RESULT {
+        CALL_DONE, //Continue with the next line
+        CALL_JUMPED, //current_line is set to a custom instruction or condition or execution finished
+        CALL_FAILED
+    };
+
+    void findAndThrowMissingBegin(int line, BLOCK block, const QString &affected = "");
+    CALL_RESULT handleCondition(const QString &condition_str, bool &result);
+    CALL_RESULT handleInstruction(const QString &instruction_str);
     bool isComment(const QString &s);
-    template <typename TOKEN> bool match(const QString &str, const TOKEN tok) const;
+    bool executeLineUnchecked();
+    QString functionAt(int line) const;
+    bool fail(STEVE_ERROR id, const QString &argument = QString(), const QString &affected = QString());
+    bool countAction();
+    bool countLine();
+    static void tokenize(SteveProgram &parsed);
+    void compile(SteveProgram &parsed);
+    bool isTailCall(const SteveProgram &parsed, int line_nr);
+    bool compileCall(const QString &call, CompiledLine &compiled_line, bool condition);
+    bool executeCompiled(bool &handled);
+    bool executeRun(int from, int end);
+    bool evaluate(const CompiledLine &compiled_line);
+    //WORLD is VirtualWorld or, if plain_world, DirectWorld (see steveinterpreter.cpp)
+    template <typename WORLD> bool evaluateCondition(WORLD world, CONDITION condition, bool has_param, int param);
+    template <typename WORLD> bool executeInstruction(WORLD world, INSTRUCTION instruction, bool has_param, int param);
+    bool call(const CompiledLine &compiled_line);
+    void pushCall();
+    bool popCall(StackFrame &frame);
+    StackFrame *callFrame();
+    bool failBudgetExceeded(STEVE_ERROR id);
+    bool checkLoop();
 
     //Structure chart generation
     void drawText(int x, int y, QPainter &painter, const QString &text);
@@ -182,35 +371,36 @@ private:
 
     //Independant
     World *world;
-
-    //Const after construction
-    QHash<KEYWORD, QString> keywords;
-    QHash<INSTRUCTION, QString> instructions;
-    QHash<CONDITION, QString> conditions;
-    QHash<INSTRUCTION, SteveFunction> instruction_functions;
-    QHash<CONDITION, SteveFunction> condition_functions;
+    bool plain_world; //Not a subclass, built-in conditions can use the non-virtual queries
+
+    //Everything a run changes, reset() replaces it with a fresh one
+    struct RunState {
+        int current_line = 0; // Starts at 0!
+        bool coming_from_condition = false, coming_from_repeat_end = false, coming_from_break = false, enter_sub = false, enter_else = false;
+        bool execution_finished = false, hit_breakpoint = false;
+        std::vector<StackFrame> frames; //Preallocated
+        bool condition_result = true; //Of the custom condition which just returned, valid if coming_from_condition
+        SteveError error; //Set by fail()
+        ExecutionStatistics statistics;
+        QElapsedTimer timer;
+        bool budget_exceeded = false;
+        QVector<quint64> line_hits, line_actions; //Only filled if profiling
+        bool loop_hash_valid = false; //Brent's algorithm: State saved at the last power of two
+        quint64 loop_hash = 0, loop_power = 1, loop_length = 0;
+    };
 
     //Execution state
-    int current_line; // Starts at 0!
-    bool coming_from_condition, coming_from_repeat_end, coming_from_break, enter_sub, enter_else, execution_finished, hit_breakpoint;
-    QStack<int> stack;
-    QStack<int> loop_count;
-    QStack<bool> custom_condition_return_stack;
+    RunState run;
+
+    //Settings, kept by reset()
+    ExecutionBudget budget;
+    bool profiling = false;
+    bool fusion = false;
+    bool loop_detection = false;
 
     //After parse
-    QHash<QString, int> custom_instructions, custom_conditions;
-    QStringList code;
-    bool code_valid;
-    QMap<int, QStringList> token;
-    QMap<int, int> branches;
-    /* 1: WENN NICHT WAND DANN (3)
-     * 2: SCHRITT
-     * 3: SONST (5)
-     * 4: RECHTSDREHEN
-     * 5: *WENN (1)
-     * branches[1] = 3;
-     * branches[3] = 5;
-     * branches[5] = 1; */
+    std::shared_ptr<const SteveProgram> program;
+    bool code_valid = false;
 };
 
 #endif // STEVEINTERPRETER_H
@@ -1,9 +1,25 @@
 #include "world.h"
 
 #include <iostream>
+#include <cstring>
 #include <QFile>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
+#include <QtEndian>
+
+/* Layout of the binary world format (.stworldb), all values little endian:
+ * 0:  "STWB"
+ * 4:  quint16 version
+ * 6:  quint16 header size (offset of the first cell)
+ * 8:  quint8 width, quint8 length
+ * 10: quint8 steve x, quint8 steve y, quint8 orientation, quint8 reserved
+ * 14: quint16 max_height
+ * Then width * length quint16 cells in the order of map[x][y]:
+ * Bit 15: cube, bit 14: mark, bits 0-13: stack size */
+static const char binary_magic[4] = {'S', 'T', 'W', 'B'};
+static const quint16 binary_version = 1;
+static const quint16 binary_header_size = 16;
+static const quint16 binary_cube = 1 << 15, binary_mark = 1 << 14, binary_stack_mask = binary_mark - 1;
 
 SignedCoords operator+(const Coords& left, const SignedCoords& right)
 {
@@ -15,6 +31,13 @@ SignedCoords operator+(const SignedCoords& left, const Coords& right)
     return {static_cast<int>(left.first + right.first), static_cast<int>(left.second + right.second)};
 }
 
+const SignedCoords World::forward_delta[4] = {
+    {0, -1}, //ORIENT_NORTH
+    {+1, 0}, //ORIENT_EAST
+    {0, +1}, //ORIENT_SOUTH
+    {-1, 0} //ORIENT_WEST
+};
+
 World::World(unsigned int width, unsigned int length, unsigned int max_height)
     : front_obj{0}, size{width, length}, max_height{max_height}
 {
@@ -47,6 +70,7 @@ bool World::resize(unsigned int width, unsigned int length)
     }
 
     updateFront();
+    rehash();
 
     return true;
 }
@@ -60,6 +84,7 @@ void World::reset()
             map[x][y] = {};
 
     updateFront();
+    rehash();
 }
 
 bool World::inBounds(SignedCoords &coords) const
@@ -74,12 +99,12 @@ bool World::isWall()
 
 bool World::isCube()
 {
-    return front_obj->has_cube;
+    return isCubeDirect();
 }
 
 bool World::frontBlocked()
 {
-    return isWall() || isCube();
+    return frontBlockedDirect();
 }
 
 bool World::stepForward()
@@ -87,70 +112,28 @@ bool World::stepForward()
     if(frontBlocked())
         return false; //Oh no! Stepped into a wall :-(
 
-    steve = front;
+    setSteve(Coords(front.first, front.second));
 
-    updateFront();
+    updateFront(); //Virtual, unlike in stepForwardDirect
 
     return true;
 }
 
 void World::turnRight(int quarters)
 {
-    quarters %= 4;
-    if(quarters > 1)
-        turnRight(quarters - 1);
-
-    switch(orientation)
-    {
-    case ORIENT_NORTH:
-        orientation = ORIENT_EAST;
-        break;
-    case ORIENT_EAST:
-        orientation = ORIENT_SOUTH;
-        break;
-    case ORIENT_SOUTH:
-        orientation = ORIENT_WEST;
-        break;
-    case ORIENT_WEST:
-        orientation = ORIENT_NORTH;
-    default:
-        break;
-    }
-
+    setOrientation(rotate(orientation, quarters));
     updateFront();
 }
 
 void World::turnLeft(int quarters)
 {
-    quarters %= 4;
-    if(quarters > 1)
-        turnLeft(quarters - 1);
-
-    switch(orientation)
-    {
-    case ORIENT_NORTH:
-        orientation = ORIENT_WEST;
-        break;
-    case ORIENT_EAST:
-        orientation = ORIENT_NORTH;
-        break;
-    case ORIENT_SOUTH:
-        orientation = ORIENT_EAST;
-        break;
-    case ORIENT_WEST:
-        orientation = ORIENT_SOUTH;
-    default:
-        break;
-    }
-
+    setOrientation(rotate(orientation, -(quarters % 4)));
     updateFront();
 }
 
 void World::setMark(bool b)
 {
-    WorldObject &obj = getObject(steve);
-    if(!obj.has_cube)
-        obj.has_mark = b;
+    setMarkDirect(b);
 }
 
 bool World::setCube(bool b)
@@ -163,73 +146,55 @@ bool World::setCube(bool b)
         return false;
 
     front_obj->has_cube = b;
+    hash ^= hashKey(front.first, front.second, HASH_CUBE);
 
     return true;
 }
 
-SignedCoords World::getForward() const
-{
-    switch(orientation)
-    {
-    case ORIENT_NORTH:
-        return {0, -1};
-    case ORIENT_SOUTH:
-        return {0, +1};
-    case ORIENT_EAST:
-        return {+1, 0};
-    case ORIENT_WEST:
-        return {-1, 0};
-    default:
-        Q_ASSERT(false);
-        return {0, 0};
-    }
-}
-
 unsigned int World::getStackSize()
 {
-    if(frontBlocked())
-        return 0; //No bricks in walls or cubes.
-
-    return getObject(front).stack_size;
+    return getStackSizeDirect(); //No bricks in walls or cubes.
 }
 
 bool World::deposit(unsigned int count)
 {
-    if(frontBlocked())
-        return false;
-
-    front_obj->stack_size += count;
-
-    if(front_obj->stack_size > max_height)
-    {
-        front_obj->stack_size = max_height;
-        return false;
-    }
-
-    return true;
+    return depositDirect(count);
 }
 
 bool World::pickup(unsigned int count)
 {
-    if(frontBlocked() || front_obj->stack_size < count)
-        return false; //Not enough bricks or in wall/cube
-
-    front_obj->stack_size -= count;
-
-    return true;
+    return pickupDirect(count); //False: Not enough bricks or in wall/cube
 }
 
 bool World::isMarked()
 {
-    return getObject(steve).has_mark;
+    return isMarkedDirect();
 }
 
 void World::updateFront()
 {
     front = steve + getForward();
 
-    if(inBounds(front))
-        front_obj = &getObject(front);
+    front_obj = inBounds(front) ? &getObject(front) : nullptr;
+}
+
+void World::placeSteve(const Coords &coords, ORIENTATION orientation)
+{
+    setSteve(coords);
+    setOrientation(orientation);
+    updateFront();
+}
+
+void World::setObject(const Coords &pos, const WorldObject &object)
+{
+    WorldObject &obj = getObject(pos);
+    if(obj.has_mark != object.has_mark)
+        hash ^= hashKey(pos.first, pos.second, HASH_MARK);
+    if(obj.has_cube != object.has_cube)
+        hash ^= hashKey(pos.first, pos.second, HASH_CUBE);
+    hash ^= stackKey(pos.first, pos.second, obj.stack_size) ^ stackKey(pos.first, pos.second, object.stack_size);
+
+    obj = object;
 }
 
 void World::dumpWorld() const
@@ -295,6 +260,7 @@ bool World::setState(WorldState &state)
     orientation = state.orientation;
 
     updateFront();
+    rehash();
 
     return true;
 }
@@ -304,14 +270,15 @@ WorldState World::getState() const
     return WorldState(steve, size, orientation, max_height, map);
 }
 
-//TODO: If canceled midway, updateFront() should be called or state not saved at all
-bool World::loadXMLStream(QXmlStreamReader &file_reader)
+//Parses into state without touching the world. state.map keeps its allocation, so parsing into
+//the same buffer again doesn't reallocate.
+bool World::parseXMLStream(QXmlStreamReader &file_reader, WorldState &state) const
 {
     bool size_set = false, steve_set = false;
     while(!file_reader.atEnd())
     {
         if(file_reader.readNext() == QXmlStreamReader::Invalid)
-            break;
+            return false;
 
         if(file_reader.isEndElement() && file_reader.name() == "world")
             break; //Finished
@@ -319,7 +286,8 @@ bool World::loadXMLStream(QXmlStreamReader &file_reader)
         if(!file_reader.isStartElement())
             continue;
 
-        if(file_reader.name().compare("world", Qt::CaseInsensitive) == 0)
+        const QStringRef name = file_reader.name();
+        if(name.compare("world", Qt::CaseInsensitive) == 0)
         {
             const QXmlStreamAttributes attributes = file_reader.attributes();
             QString width_str = attributes.value("width").toString();
@@ -340,16 +308,24 @@ bool World::loadXMLStream(QXmlStreamReader &file_reader)
             else if(!ok)
                 return false;
 
-            if(!resize(width, length))
+            if(width > maximum_size.first || length > maximum_size.second
+                    || width < minimum_size.first || length < minimum_size.second)
                 return false;
 
-            this->max_height = max_height;
+            state.size = {width, length};
+            state.max_height = max_height;
+            state.steve = {0, 0};
+            state.orientation = ORIENT_SOUTH;
 
-            reset();
+            state.map.resize(width);
+            for(auto &column : state.map)
+                column.assign(length, {});
 
             size_set = true;
         }
-        else if(file_reader.name().compare("steve", Qt::CaseInsensitive) == 0)
+        else if(!size_set)
+            return false; //Everything else needs the size
+        else if(name.compare("steve", Qt::CaseInsensitive) == 0)
         {
             const QXmlStreamAttributes attributes = file_reader.attributes();
             QString x_str = attributes.value("x").toString();
@@ -373,21 +349,15 @@ bool World::loadXMLStream(QXmlStreamReader &file_reader)
                     break;
                 }
             }
-            if(orientation == ORIENT_INVALID)
-                    return false;
 
-            if(x >= size.first || y >= size.second)
-                return false;
-
-            steve.first = x;
-            steve.second = y;
-            this->orientation = orientation;
+            state.steve = {x, y};
+            state.orientation = orientation;
 
             steve_set = true;
         }
-        else if(file_reader.name().compare("stack", Qt::CaseInsensitive) == 0
-                || file_reader.name().compare("cube", Qt::CaseInsensitive) == 0
-                || file_reader.name().compare("mark", Qt::CaseInsensitive) == 0)
+        else if(name.compare("stack", Qt::CaseInsensitive) == 0
+                || name.compare("cube", Qt::CaseInsensitive) == 0
+                || name.compare("mark", Qt::CaseInsensitive) == 0)
         {
             const QXmlStreamAttributes attributes = file_reader.attributes();
             QString x_str = attributes.value("x").toString();
@@ -401,12 +371,12 @@ bool World::loadXMLStream(QXmlStreamReader &file_reader)
             if(y_str.isEmpty() || !ok)
                     return false;
 
-            if(x >= size.first || y >= size.second)
+            if(x >= state.size.first || y >= state.size.second)
                 return false;
 
-            WorldObject *obj = &(map[x][y]);
+            WorldObject *obj = &(state.map[x][y]);
 
-            if(file_reader.name().compare("stack", Qt::CaseInsensitive) == 0)
+            if(name.compare("stack", Qt::CaseInsensitive) == 0)
             {
                 QString height_str = attributes.value("height").toString();
                 unsigned int height = height_str.toUInt(&ok);
@@ -416,13 +386,13 @@ bool World::loadXMLStream(QXmlStreamReader &file_reader)
                 obj->stack_size = height;
                 obj->has_cube = false;
             }
-            else if(file_reader.name().compare("cube", Qt::CaseInsensitive) == 0)
+            else if(name.compare("cube", Qt::CaseInsensitive) == 0)
             {
                 obj->has_cube = true;
                 obj->has_mark = false;
                 obj->stack_size = 0;
             }
-            else if(file_reader.name().compare("mark", Qt::CaseInsensitive) == 0)
+            else
             {
                 obj->has_mark = true;
                 obj->has_cube = false;
@@ -430,18 +400,51 @@ bool World::loadXMLStream(QXmlStreamReader &file_reader)
         }
     }
 
-    updateFront();
+    if(!size_set || !steve_set)
+        return false;
+
+    //Validated once, after everything has been read
+    return state.orientation != ORIENT_INVALID
+            && state.steve.first < state.size.first && state.steve.second < state.size.second;
+}
+
+//Replaces the world with load_buffer. The old grid ends up in load_buffer, ready to be reused.
+//Doesn't notify subclasses, they do that once after a load.
+void World::commitLoadBuffer()
+{
+    std::swap(map, load_buffer.map);
+    size = load_buffer.size;
+    steve = load_buffer.steve;
+    orientation = load_buffer.orientation;
+    max_height = load_buffer.max_height;
+
+    World::updateFront();
+    rehash();
+}
+
+bool World::loadXMLStream(QXmlStreamReader &file_reader)
+{
+    if(!parseXMLStream(file_reader, load_buffer))
+        return false;
+
+    commitLoadBuffer();
 
-    return size_set && steve_set;
+    return true;
 }
 
 
 bool World::loadFile(const QString &filename)
 {
     QFile file{filename};
-    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if(!file.open(QIODevice::ReadOnly))
         return false;
 
+    if(isBinary(file.peek(sizeof(binary_magic))))
+    {
+        file.close();
+        return loadBinaryFile(filename);
+    }
+
     QXmlStreamReader file_reader(&file);
 
     return loadXMLStream(file_reader);
@@ -513,10 +516,146 @@ bool World::saveFile(const QString &filename) const
     return !file_writer.hasError();
 }
 
+bool World::isBinary(const QByteArray &header)
+{
+    return header.size() >= static_cast<int>(sizeof(binary_magic))
+            && memcmp(header.constData(), binary_magic, sizeof(binary_magic)) == 0;
+}
+
+QByteArray World::toBinary() const
+{
+    //The header can't represent bigger values
+    if(max_height > 0xFFFF)
+        return {};
+
+    QByteArray data(binary_header_size + 2 * static_cast<int>(size.first * size.second), '\0');
+    uchar *header = reinterpret_cast<uchar*>(data.data());
+
+    memcpy(header, binary_magic, sizeof(binary_magic));
+    qToLittleEndian<quint16>(binary_version, header + 4);
+    qToLittleEndian<quint16>(binary_header_size, header + 6);
+    header[8] = size.first;
+    header[9] = size.second;
+    header[10] = steve.first;
+    header[11] = steve.second;
+    header[12] = orientation;
+    qToLittleEndian<quint16>(max_height, header + 14);
+
+    uchar *cell = header + binary_header_size;
+    for(unsigned int x = 0; x < size.first; x++)
+        for(unsigned int y = 0; y < size.second; y++, cell += 2)
+        {
+            const WorldObject &obj = map[x][y];
+            if(obj.stack_size > binary_stack_mask)
+                return {};
+
+            quint16 value = obj.stack_size;
+            if(obj.has_cube)
+                value |= binary_cube;
+            if(obj.has_mark)
+                value |= binary_mark;
+
+            qToLittleEndian<quint16>(value, cell);
+        }
+
+    return data;
+}
+
+bool World::saveBinaryFile(const QString &filename) const
+{
+    QByteArray data = toBinary();
+    if(data.isEmpty())
+        return false;
+
+    QFile file{filename};
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    return file.write(data) == data.size();
+}
+
+bool World::loadBinaryFile(const QString &filename)
+{
+    QFile file{filename};
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    //Map the file if possible, compressed resources can't be mapped
+    if(uchar *data = file.map(0, file.size()))
+        return loadBinary(data, file.size());
+
+    QByteArray data = file.readAll();
+    return loadBinary(reinterpret_cast<const uchar*>(data.constData()), data.size());
+}
+
+//Decoded into load_buffer first, so a broken file doesn't leave a half-loaded world
+bool World::loadBinary(const uchar *data, qint64 data_size)
+{
+    if(data_size < binary_header_size || memcmp(data, binary_magic, sizeof(binary_magic)) != 0)
+        return false;
+
+    quint16 version = qFromLittleEndian<quint16>(data + 4);
+    quint16 header_size = qFromLittleEndian<quint16>(data + 6);
+    if(version != binary_version || header_size < binary_header_size)
+        return false;
+
+    unsigned int width = data[8], length = data[9];
+    if(width > maximum_size.first || length > maximum_size.second
+            || width < minimum_size.first || length < minimum_size.second)
+        return false;
+
+    if(data_size < header_size + 2 * static_cast<qint64>(width * length))
+        return false;
+
+    unsigned int steve_x = data[10], steve_y = data[11];
+    if(steve_x >= width || steve_y >= length || data[12] > ORIENT_WEST)
+        return false;
+
+    //Same limit as setMaxHeight()
+    const unsigned int max_height = qFromLittleEndian<quint16>(data + 14);
+    if(max_height > maximum_height)
+        return false;
+
+    const uchar *cells = data + header_size;
+    load_buffer.map.resize(width);
+    for(unsigned int x = 0; x < width; x++)
+    {
+        std::vector<WorldObject> &column = load_buffer.map[x];
+        column.resize(length);
+
+        for(unsigned int y = 0; y < length; y++, cells += 2)
+        {
+            quint16 value = qFromLittleEndian<quint16>(cells);
+            if((value & binary_cube) && (value & (binary_mark | binary_stack_mask)))
+                return false; //Nothing can be on or under a cube
+
+            if((value & binary_stack_mask) > max_height)
+                return false;
+
+            column[y].has_cube = value & binary_cube;
+            column[y].has_mark = value & binary_mark;
+            column[y].stack_size = value & binary_stack_mask;
+        }
+    }
+
+    load_buffer.size = {width, length};
+    load_buffer.steve = {steve_x, steve_y};
+    load_buffer.orientation = static_cast<ORIENTATION>(data[12]);
+    load_buffer.max_height = max_height;
+
+    //Steve can't stand in a cube
+    if(load_buffer.map[steve_x][steve_y].has_cube)
+        return false;
+
+    commitLoadBuffer();
+
+    return true;
+}
+
 void World::setMaxHeight(unsigned int max_height)
 {
     //Don't accept ridiculously high worlds...
-    if(max_height > 100)
+    if(max_height > maximum_height)
         return;
 
     this->max_height = max_height;
@@ -529,4 +668,31 @@ void World::setMaxHeight(unsigned int max_height)
             if(obj->stack_size > max_height)
                 obj->stack_size = max_height;
         }
+
+    rehash();
+}
+
+quint64 World::mixHash(quint64 value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+void World::rehash()
+{
+    hash = hashKey(steve.first, steve.second, HASH_STEVE) ^ hashKey(0, 0, HASH_ORIENTATION, orientation);
+
+    for(unsigned int x = 0; x < size.first; x++)
+        for(unsigned int y = 0; y < size.second; y++)
+        {
+            const WorldObject &obj = map[x][y];
+            if(obj.has_mark)
+                hash ^= hashKey(x, y, HASH_MARK);
+            if(obj.has_cube)
+                hash ^= hashKey(x, y, HASH_CUBE);
+
+            hash ^= stackKey(x, y, obj.stack_size);
+        }
 }
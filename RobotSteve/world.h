@@ -5,6 +5,7 @@
 #include <map>
 #include <utility>
 #include <QString>
+#include <QByteArray>
 #include <QXmlStreamReader>
 
 typedef std::pair<int,int> SignedCoords;
@@ -70,6 +71,64 @@ public:
     unsigned int getX() const { return steve.first; }
     unsigned int getY() const { return steve.second; }
     WorldObject &getObject(const Coords &pos) { return map[pos.first][pos.second]; }
+    const WorldObject &getObject(const Coords &pos) const { return map[pos.first][pos.second]; }
+    SignedCoords getFront() const { return front; } //Can be outside of the world
+
+    //For replaying recorded runs: Set what the primitives changed, without their rules.
+    //coords and pos have to be inside of the world.
+    void placeSteve(const Coords &coords, ORIENTATION orientation);
+    void setObject(const Coords &pos, const WorldObject &object);
+
+    //Non-virtual versions for the interpreter, which uses them if the world is exactly a World.
+    //The virtual functions do the same, but subclasses can hook into them.
+    bool isWallDirect() const { return !front_obj; }
+    bool frontBlockedDirect() const { return !front_obj || front_obj->has_cube; }
+    bool isCubeDirect() const { return front_obj && front_obj->has_cube; }
+    unsigned int getStackSizeDirect() const { return frontBlockedDirect() ? 0 : front_obj->stack_size; }
+    bool isMarkedDirect() const { return map[steve.first][steve.second].has_mark; }
+    void turnRightDirect(int quarters) { setOrientation(rotate(orientation, quarters)); World::updateFront(); }
+    void turnLeftDirect(int quarters) { setOrientation(rotate(orientation, -(quarters % 4))); World::updateFront(); }
+    bool stepForwardDirect()
+    {
+        if(frontBlockedDirect())
+            return false;
+
+        setSteve(Coords(front.first, front.second));
+        World::updateFront();
+        return true;
+    }
+    void setMarkDirect(bool b)
+    {
+        WorldObject &obj = getObject(steve);
+        if(obj.has_cube || obj.has_mark == b)
+            return;
+
+        obj.has_mark = b;
+        hash ^= hashKey(steve.first, steve.second, HASH_MARK);
+    }
+    bool depositDirect(unsigned int count)
+    {
+        if(frontBlockedDirect())
+            return false;
+
+        bool success = front_obj->stack_size + count <= max_height;
+        setFrontStackSize(success ? front_obj->stack_size + count : max_height);
+        return success;
+    }
+    bool pickupDirect(unsigned int count)
+    {
+        if(frontBlockedDirect() || front_obj->stack_size < count)
+            return false;
+
+        setFrontStackSize(front_obj->stack_size - count);
+        return true;
+    }
+
+    //Zobrist hash of the map, Steve's position and his orientation, updated by every change.
+    //Equal worlds have equal hashes. Code which changes objects through getObject() has to call rehash().
+    quint64 getHash() const { return hash; }
+    void rehash();
+    static quint64 mixHash(quint64 value); //splitmix64 finalizer
 
     unsigned int getMaxHeight() const { return max_height; }
     virtual void setMaxHeight(unsigned int max_height);
@@ -83,13 +142,58 @@ public:
     bool loadXML(const QString &xml);
     virtual bool loadXMLStream(QXmlStreamReader &file_reader);
 
+    //Binary format (.stworldb), for bulk loading. XML stays the interchange format.
+    QByteArray toBinary() const;
+    bool saveBinaryFile(const QString &filename) const;
+    bool loadBinaryFile(const QString &filename);
+    virtual bool loadBinary(const uchar *data, qint64 size);
+    static bool isBinary(const QByteArray &header);
+
     const Size maximum_size = {25, 25}, minimum_size = {3, 3};
+    const unsigned int maximum_height = 100;
 
 protected:
-    SignedCoords getForward() const;
+    bool parseXMLStream(QXmlStreamReader &file_reader, WorldState &state) const;
+    void commitLoadBuffer();
+
+    SignedCoords getForward() const { return forward_delta[orientation]; }
+    //Clockwise, quarters can be negative or more than a full turn
+    static ORIENTATION rotate(ORIENTATION orientation, int quarters) { return static_cast<ORIENTATION>(((orientation + quarters % 4) % 4 + 4) % 4); }
     virtual void updateFront();
     bool inBounds(SignedCoords &coords) const;
 
+    static const SignedCoords forward_delta[4]; //Indexed by ORIENTATION
+
+    enum HASH_PART {
+        HASH_MARK = 1,
+        HASH_CUBE,
+        HASH_STACK,
+        HASH_STEVE,
+        HASH_ORIENTATION
+    };
+
+    //Random looking key for each part of the state, computed instead of stored in a table because stacks can be high
+    static quint64 hashKey(unsigned int x, unsigned int y, HASH_PART part, quint64 value = 0)
+    {
+        return mixHash((static_cast<quint64>(x) << 56) | (static_cast<quint64>(y) << 48) | (static_cast<quint64>(part) << 40) | value);
+    }
+    static quint64 stackKey(unsigned int x, unsigned int y, unsigned int stack_size) { return stack_size ? hashKey(x, y, HASH_STACK, stack_size) : 0; }
+    void setSteve(const Coords &coords)
+    {
+        hash ^= hashKey(steve.first, steve.second, HASH_STEVE) ^ hashKey(coords.first, coords.second, HASH_STEVE);
+        steve = coords;
+    }
+    void setOrientation(ORIENTATION orientation)
+    {
+        hash ^= hashKey(0, 0, HASH_ORIENTATION, this->orientation) ^ hashKey(0, 0, HASH_ORIENTATION, orientation);
+        this->orientation = orientation;
+    }
+    void setFrontStackSize(unsigned int stack_size)
+    {
+        hash ^= stackKey(front.first, front.second, front_obj->stack_size) ^ stackKey(front.first, front.second, stack_size);
+        front_obj->stack_size = stack_size;
+    }
+
     //Not translated to keep the world file format compatible
     const std::map<ORIENTATION,QString> orientation_str = {
         std::make_pair(ORIENT_NORTH, "north"),
@@ -98,7 +202,7 @@ protected:
         std::make_pair(ORIENT_WEST, "west")
     };
 
-    WorldObject *front_obj;
+    WorldObject *front_obj; //nullptr if there's a wall in front
     Size size;
     Coords steve;
     //This has to be signed; if steve is at (1,0) and looking at the wall, front is (1,-1)
@@ -106,6 +210,9 @@ protected:
     ORIENTATION orientation = ORIENT_SOUTH;
     std::vector<std::vector<WorldObject>> map;
     unsigned int max_height;
+    quint64 hash = 0;
+
+    WorldState load_buffer; //Loaders parse into this and swap it in on success
 };
 
 #endif // WORLD_H
@@ -0,0 +1,220 @@
+#include <cstring>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include "worldarchive.h"
+
+/* Layout of a world archive (.stworlda), all values little endian:
+ * 0:  "STWA"
+ * 4:  quint16 version
+ * 6:  quint16 reserved
+ * 8:  quint32 number of entries
+ * 12: quint32 number of unique worlds
+ * 16: quint64 offset of the index
+ * 24: The unique worlds in the binary world format, back to back
+ * Index: For every entry quint16 length of the name, UTF-8 name, quint64 offset and quint32 size of the world */
+static const char archive_magic[4] = {'S', 'T', 'W', 'A'};
+static const quint16 archive_version = 1;
+static const int archive_header_size = 24;
+
+WorldArchive::~WorldArchive()
+{
+    clear();
+}
+
+void WorldArchive::clear()
+{
+    if(file.isOpen())
+        file.close(); //Also unmaps
+
+    data = nullptr;
+    data_size = 0;
+    data_copy.clear();
+
+    names.clear();
+    index.clear();
+    blobs.clear();
+    blob_by_hash.clear();
+    entry_blob.clear();
+    entry_file.clear();
+    blob_count = 0;
+}
+
+bool WorldArchive::isArchive(const QByteArray &header)
+{
+    return header.size() >= static_cast<int>(sizeof(archive_magic))
+            && memcmp(header.constData(), archive_magic, sizeof(archive_magic)) == 0;
+}
+
+bool WorldArchive::addWorld(const QString &name, const World &world)
+{
+    if(name.isEmpty() || contains(name))
+        return false;
+
+    QByteArray blob = world.toBinary();
+    if(blob.isEmpty())
+        return false;
+
+    //Only store identical worlds once
+    QByteArray hash = QCryptographicHash::hash(blob, QCryptographicHash::Sha1);
+    auto existing = blob_by_hash.constFind(hash);
+    if(existing != blob_by_hash.constEnd() && blobs[*existing] == blob)
+        entry_blob[name] = *existing;
+    else
+    {
+        blob_by_hash[hash] = blobs.size();
+        entry_blob[name] = blobs.size();
+        blobs.append(blob);
+    }
+
+    names.append(name);
+    blob_count = blobs.size();
+
+    return true;
+}
+
+bool WorldArchive::addWorldFile(const QString &filename)
+{
+    World world{5, 5, 5};
+    if(!world.loadFile(filename))
+        return false;
+
+    //Entries are named after the file, so worlds with the same name from different directories clash
+    const QString name = QFileInfo(filename).fileName();
+    if(!addWorld(name, world))
+        return false;
+
+    entry_file[name] = filename;
+
+    return true;
+}
+
+bool WorldArchive::saveFile(const QString &filename) const
+{
+    QFile out{filename};
+    if(!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QVector<quint64> blob_offsets;
+    quint64 offset = archive_header_size;
+    for(const QByteArray &blob : blobs)
+    {
+        blob_offsets.append(offset);
+        offset += blob.size();
+    }
+
+    uchar header[archive_header_size] = {};
+    memcpy(header, archive_magic, sizeof(archive_magic));
+    qToLittleEndian<quint16>(archive_version, header + 4);
+    qToLittleEndian<quint32>(names.size(), header + 8);
+    qToLittleEndian<quint32>(blobs.size(), header + 12);
+    qToLittleEndian<quint64>(offset, header + 16);
+
+    if(out.write(reinterpret_cast<const char*>(header), archive_header_size) != archive_header_size)
+        return false;
+
+    for(const QByteArray &blob : blobs)
+        if(out.write(blob) != blob.size())
+            return false;
+
+    QByteArray index_data;
+    for(const QString &name : names)
+    {
+        QByteArray name_utf8 = name.toUtf8();
+        if(name_utf8.size() > 0xFFFF)
+            return false;
+
+        int blob = entry_blob[name];
+        uchar entry[8 + 4];
+        qToLittleEndian<quint64>(blob_offsets[blob], entry);
+        qToLittleEndian<quint32>(blobs[blob].size(), entry + 8);
+
+        uchar name_length[2];
+        qToLittleEndian<quint16>(name_utf8.size(), name_length);
+
+        index_data.append(reinterpret_cast<const char*>(name_length), sizeof(name_length));
+        index_data.append(name_utf8);
+        index_data.append(reinterpret_cast<const char*>(entry), sizeof(entry));
+    }
+
+    return out.write(index_data) == index_data.size();
+}
+
+//Only the index is read, the worlds stay in the (mapped) file until they are needed
+bool WorldArchive::loadFile(const QString &filename)
+{
+    clear();
+
+    file.setFileName(filename);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    data_size = file.size();
+    data = file.map(0, data_size);
+    if(!data)
+    {
+        //Compressed resources can't be mapped
+        data_copy = file.readAll();
+        data = reinterpret_cast<const uchar*>(data_copy.constData());
+        data_size = data_copy.size();
+    }
+
+    if(data_size < archive_header_size || memcmp(data, archive_magic, sizeof(archive_magic)) != 0
+            || qFromLittleEndian<quint16>(data + 4) != archive_version)
+    {
+        clear();
+        return false;
+    }
+
+    quint32 entries = qFromLittleEndian<quint32>(data + 8);
+    quint64 pos = qFromLittleEndian<quint64>(data + 16);
+    const quint64 end = data_size;
+
+    for(quint32 i = 0; i < entries; i++)
+    {
+        //Compared without adding to pos, which comes from the file and could overflow
+        if(pos > end || end - pos < 2)
+            break;
+
+        quint16 name_length = qFromLittleEndian<quint16>(data + pos);
+        pos += 2;
+
+        if(static_cast<quint64>(name_length) + 12 > end - pos)
+            break;
+
+        QString name = QString::fromUtf8(reinterpret_cast<const char*>(data + pos), name_length);
+        pos += name_length;
+
+        Entry entry;
+        entry.offset = qFromLittleEndian<quint64>(data + pos);
+        entry.size = qFromLittleEndian<quint32>(data + pos + 8);
+        pos += 12;
+
+        if(entry.offset < archive_header_size || entry.offset > end || entry.size > end - entry.offset || index.contains(name))
+            break;
+
+        names.append(name);
+        index[name] = entry;
+    }
+
+    //Truncated or corrupt index
+    if(names.size() != static_cast<int>(entries))
+    {
+        clear();
+        return false;
+    }
+
+    blob_count = qFromLittleEndian<quint32>(data + 12);
+
+    return true;
+}
+
+bool WorldArchive::loadWorld(const QString &name, World &world) const
+{
+    auto entry = index.constFind(name);
+    if(entry == index.constEnd())
+        return false;
+
+    return world.loadBinary(data + entry->offset, entry->size);
+}
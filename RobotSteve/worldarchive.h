@@ -0,0 +1,65 @@
+#ifndef WORLDARCHIVE_H
+#define WORLDARCHIVE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QFile>
+
+#include "world.h"
+
+//Many worlds in one file (.stworlda), stored in the binary world format.
+//Identical worlds are only stored once.
+class WorldArchive
+{
+public:
+    WorldArchive() {}
+    ~WorldArchive();
+
+    //Writing
+    bool addWorld(const QString &name, const World &world);
+    bool addWorldFile(const QString &filename);
+    bool saveFile(const QString &filename) const;
+
+    //Reading, the worlds are only decoded on loadWorld()
+    bool loadFile(const QString &filename);
+    bool loadWorld(const QString &name, World &world) const;
+    const QStringList &getNames() const { return names; }
+    bool contains(const QString &name) const { return index.contains(name) || entry_blob.contains(name); }
+    int getUniqueCount() const { return blob_count; }
+    //Writing: The file an entry was added from by addWorldFile(), to report name clashes
+    QString getFileOf(const QString &name) const { return entry_file.value(name); }
+
+    static bool isArchive(const QByteArray &header);
+
+private:
+    WorldArchive(const WorldArchive &other) = delete;
+    WorldArchive &operator=(const WorldArchive &other) = delete;
+
+    void clear();
+
+    struct Entry {
+        quint64 offset;
+        quint32 size;
+    };
+
+    QStringList names; //In the order they were added
+    QHash<QString, Entry> index;
+    int blob_count = 0;
+
+    //Reading: Either mapped or read into memory
+    QFile file;
+    const uchar *data = nullptr;
+    qint64 data_size = 0;
+    QByteArray data_copy;
+
+    //Writing: Blobs are appended after the header in this order
+    QVector<QByteArray> blobs;
+    QHash<QByteArray, int> blob_by_hash;
+    QHash<QString, int> entry_blob;
+    QHash<QString, QString> entry_file;
+};
+
+#endif // WORLDARCHIVE_H
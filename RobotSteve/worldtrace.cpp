@@ -0,0 +1,418 @@
+#include <cstring>
+#include <QtEndian>
+
+#include "worldtrace.h"
+
+/* Layout of a trace (.sttrace), fixed size values little endian:
+ * 0:  "STTR"
+ * 4:  quint16 version
+ * 6:  quint16 reserved
+ * 8:  quint32 checkpoint interval
+ * 12: quint64 number of steps
+ * 20: quint64 offset of the index
+ * 28: Checkpoint 0, steps 1 to interval, checkpoint 1, steps interval + 1 to 2 * interval, ...
+ * Index: quint64 offset of every checkpoint
+ *
+ * Numbers in records are varints, 7 bits per byte, lowest first, the high bit set if more follow.
+ * Signed numbers are zigzag encoded (0, -1, 1, -2, ... becomes 0, 1, 2, 3, ...).
+ * Checkpoint: line, size of the world, the world in the binary world format
+ * Step: (line - previous line) << 3 | changes, then for the changes in this order
+ *       STEP_MOVED: x - previous x, y - previous y
+ *       STEP_TURNED: orientation
+ *       STEP_FIELDS: number of fields, for each x, y, stack size << 2 | cube << 1 | mark */
+static const char trace_magic[4] = {'S', 'T', 'T', 'R'};
+static const quint16 trace_version = 1;
+static const int trace_header_size = 28;
+static const int trace_buffer_size = 64 * 1024;
+
+enum STEP_CHANGES {
+    STEP_MOVED = 1,
+    STEP_TURNED = 2,
+    STEP_FIELDS = 4
+};
+
+static quint64 zigzag(qint64 value)
+{
+    return (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+}
+
+static qint64 unzigzag(quint64 value)
+{
+    return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+}
+
+static quint64 objectValue(const WorldObject &object)
+{
+    return static_cast<quint64>(object.stack_size) << 2 | object.has_cube << 1 | object.has_mark;
+}
+
+static bool sameObject(const WorldObject &a, const WorldObject &b)
+{
+    return a.stack_size == b.stack_size && a.has_cube == b.has_cube && a.has_mark == b.has_mark;
+}
+
+bool TraceWriter::open(const QString &filename, const World &world, int line, quint32 checkpoint_interval)
+{
+    file.setFileName(filename);
+    if(checkpoint_interval == 0 || !file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    interval = checkpoint_interval;
+    steps = 0;
+    checkpoints.clear();
+    failed = false;
+
+    //The counts are filled in by close()
+    buffer = QByteArray(trace_header_size, '\0');
+    uchar *header = reinterpret_cast<uchar*>(buffer.data());
+    memcpy(header, trace_magic, sizeof(trace_magic));
+    qToLittleEndian<quint16>(trace_version, header + 4);
+    qToLittleEndian<quint32>(interval, header + 8);
+    offset = trace_header_size;
+
+    writeCheckpoint(world, line);
+    remember(world, line);
+
+    return !failed;
+}
+
+void TraceWriter::remember(const World &world, int line)
+{
+    steve = Coords(world.getX(), world.getY());
+    orientation = world.getOrientation();
+    this->line = line;
+
+    field_pos[0] = steve;
+    field[0] = world.getObject(steve);
+    field_count = 1;
+
+    const SignedCoords front = world.getFront();
+    if(front.first >= 0 && front.second >= 0
+            && static_cast<unsigned int>(front.first) < world.getSize().first && static_cast<unsigned int>(front.second) < world.getSize().second)
+    {
+        field_pos[1] = Coords(front.first, front.second);
+        field[1] = world.getObject(field_pos[1]);
+        field_count = 2;
+    }
+}
+
+void TraceWriter::step(const World &world, int line)
+{
+    if(!file.isOpen())
+        return;
+
+    const Coords now{world.getX(), world.getY()};
+    int changed[2], changed_count = 0;
+    for(int i = 0; i < field_count; i++)
+        if(!sameObject(field[i], world.getObject(field_pos[i])))
+            changed[changed_count++] = i;
+
+    quint64 changes = 0;
+    if(now != steve)
+        changes |= STEP_MOVED;
+    if(world.getOrientation() != orientation)
+        changes |= STEP_TURNED;
+    if(changed_count)
+        changes |= STEP_FIELDS;
+
+    writeVarint(zigzag(static_cast<qint64>(line) - this->line) << 3 | changes);
+
+    if(changes & STEP_MOVED)
+    {
+        writeVarint(zigzag(static_cast<qint64>(now.first) - steve.first));
+        writeVarint(zigzag(static_cast<qint64>(now.second) - steve.second));
+    }
+
+    if(changes & STEP_TURNED)
+        writeVarint(world.getOrientation());
+
+    if(changes & STEP_FIELDS)
+    {
+        writeVarint(changed_count);
+        for(int i = 0; i < changed_count; i++)
+        {
+            const Coords &pos = field_pos[changed[i]];
+            writeVarint(pos.first);
+            writeVarint(pos.second);
+            writeVarint(objectValue(world.getObject(pos)));
+        }
+    }
+
+    steps++;
+    if(steps % interval == 0)
+        writeCheckpoint(world, line);
+
+    remember(world, line);
+
+    if(buffer.size() >= trace_buffer_size)
+        flush();
+}
+
+void TraceWriter::writeCheckpoint(const World &world, int line)
+{
+    const QByteArray blob = world.toBinary();
+    if(blob.isEmpty())
+        failed = true;
+
+    checkpoints.append(offset);
+    writeVarint(zigzag(line));
+    writeVarint(blob.size());
+    buffer.append(blob);
+    offset += blob.size();
+}
+
+void TraceWriter::writeVarint(quint64 value)
+{
+    while(value >= 0x80)
+    {
+        buffer.append(static_cast<char>(value | 0x80));
+        value >>= 7;
+        offset++;
+    }
+
+    buffer.append(static_cast<char>(value));
+    offset++;
+}
+
+void TraceWriter::flush()
+{
+    if(file.write(buffer) != buffer.size())
+        failed = true;
+
+    buffer.clear();
+}
+
+bool TraceWriter::close()
+{
+    if(!file.isOpen())
+        return false;
+
+    const quint64 index_offset = offset;
+    for(quint64 checkpoint : checkpoints)
+    {
+        uchar entry[8];
+        qToLittleEndian<quint64>(checkpoint, entry);
+        buffer.append(reinterpret_cast<const char*>(entry), sizeof(entry));
+        offset += sizeof(entry);
+    }
+
+    flush();
+
+    uchar counts[16];
+    qToLittleEndian<quint64>(steps, counts);
+    qToLittleEndian<quint64>(index_offset, counts + 8);
+    if(!file.seek(12) || file.write(reinterpret_cast<const char*>(counts), sizeof(counts)) != sizeof(counts))
+        failed = true;
+
+    file.close();
+
+    return !failed;
+}
+
+TraceReader::~TraceReader()
+{
+    clear();
+}
+
+void TraceReader::clear()
+{
+    if(file.isOpen())
+        file.close(); //Also unmaps
+
+    data = nullptr;
+    data_size = 0;
+    data_copy.clear();
+
+    checkpoints.clear();
+    steps = 0;
+    interval = 0;
+    positioned = false;
+}
+
+bool TraceReader::loadFile(const QString &filename)
+{
+    clear();
+
+    file.setFileName(filename);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    data_size = file.size();
+    data = file.map(0, data_size);
+    if(!data)
+    {
+        data_copy = file.readAll();
+        data = reinterpret_cast<const uchar*>(data_copy.constData());
+        data_size = data_copy.size();
+    }
+
+    if(data_size < trace_header_size || memcmp(data, trace_magic, sizeof(trace_magic)) != 0
+            || qFromLittleEndian<quint16>(data + 4) != trace_version)
+    {
+        clear();
+        return false;
+    }
+
+    interval = qFromLittleEndian<quint32>(data + 8);
+    steps = qFromLittleEndian<quint64>(data + 12);
+    const quint64 index_offset = qFromLittleEndian<quint64>(data + 20);
+    const quint64 checkpoint_count = interval ? steps / interval + 1 : 0;
+
+    //Not closed or cut off
+    if(interval == 0 || index_offset < trace_header_size || index_offset > data_size
+            || (data_size - index_offset) / 8 != checkpoint_count)
+    {
+        clear();
+        return false;
+    }
+
+    for(quint64 i = 0; i < checkpoint_count; i++)
+    {
+        const quint64 checkpoint = qFromLittleEndian<quint64>(data + index_offset + 8 * i);
+        if(checkpoint < trace_header_size || checkpoint >= index_offset)
+        {
+            clear();
+            return false;
+        }
+
+        checkpoints.append(checkpoint);
+    }
+
+    return true;
+}
+
+bool TraceReader::readVarint(quint64 &value)
+{
+    value = 0;
+    for(int shift = 0; shift < 64 && pos < data_size; shift += 7)
+    {
+        const uchar byte = data[pos++];
+        value |= static_cast<quint64>(byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+//Only skipped if world is nullptr
+bool TraceReader::readCheckpoint(World *world)
+{
+    quint64 checkpoint_line, size;
+    if(!readVarint(checkpoint_line) || !readVarint(size) || size > data_size - pos)
+        return false;
+
+    if(world)
+    {
+        if(!world->loadBinary(data + pos, size))
+            return false;
+
+        line = unzigzag(checkpoint_line);
+    }
+
+    pos += size;
+
+    return true;
+}
+
+bool TraceReader::readStep(World &world)
+{
+    quint64 value;
+    if(!readVarint(value))
+        return false;
+
+    const quint64 changes = value & 7;
+    const int next_line = line + unzigzag(value >> 3);
+
+    qint64 x = world.getX(), y = world.getY();
+    ORIENTATION orientation = world.getOrientation();
+
+    if(changes & STEP_MOVED)
+    {
+        quint64 dx, dy;
+        if(!readVarint(dx) || !readVarint(dy))
+            return false;
+
+        x += unzigzag(dx);
+        y += unzigzag(dy);
+        if(x < 0 || y < 0 || x >= world.getSize().first || y >= world.getSize().second)
+            return false;
+    }
+
+    if(changes & STEP_TURNED)
+    {
+        quint64 new_orientation;
+        if(!readVarint(new_orientation) || new_orientation > ORIENT_WEST)
+            return false;
+
+        orientation = static_cast<ORIENTATION>(new_orientation);
+    }
+
+    if(changes & STEP_FIELDS)
+    {
+        quint64 count;
+        if(!readVarint(count) || count > 2)
+            return false;
+
+        for(quint64 i = 0; i < count; i++)
+        {
+            quint64 field_x, field_y, object_value;
+            if(!readVarint(field_x) || !readVarint(field_y) || !readVarint(object_value)
+                    || field_x >= world.getSize().first || field_y >= world.getSize().second)
+                return false;
+
+            WorldObject object;
+            object.has_mark = object_value & 1;
+            object.has_cube = object_value & 2;
+            object.stack_size = object_value >> 2;
+            world.setObject(Coords(field_x, field_y), object);
+        }
+    }
+
+    if(changes & (STEP_MOVED | STEP_TURNED))
+        world.placeSteve(Coords(x, y), orientation);
+
+    line = next_line;
+
+    return true;
+}
+
+bool TraceReader::seek(quint64 step, World &world)
+{
+    positioned = false;
+    if(step > steps)
+        return false;
+
+    pos = checkpoints[step / interval];
+    current_step = step / interval * interval;
+    if(!readCheckpoint(&world))
+        return false;
+
+    positioned = true;
+    while(current_step < step)
+        if(!next(world))
+            return false;
+
+    return true;
+}
+
+bool TraceReader::next(World &world)
+{
+    if(!positioned || current_step >= steps)
+        return false;
+
+    if(!readStep(world))
+    {
+        positioned = false;
+        return false;
+    }
+
+    current_step++;
+    if(current_step % interval == 0 && !readCheckpoint(nullptr))
+    {
+        positioned = false;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef WORLDTRACE_H
+#define WORLDTRACE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+
+#include "world.h"
+
+//Recording of a run (.sttrace): After every executeLine() what changed in the world and the next line.
+//Every checkpoint_interval steps the whole world is stored, so any step can be restored quickly.
+class TraceWriter
+{
+public:
+    TraceWriter() {}
+
+    //world and line before the first step
+    bool open(const QString &filename, const World &world, int line, quint32 checkpoint_interval = 4096);
+    //After every executeLine(). Only one action per step is recorded, so the interpreter must not fuse instructions.
+    void step(const World &world, int line);
+    //Writes the index, the trace is unusable without it
+    bool close();
+
+    quint64 getStepCount() const { return steps; }
+
+private:
+    TraceWriter(const TraceWriter &other) = delete;
+    TraceWriter &operator=(const TraceWriter &other) = delete;
+
+    void remember(const World &world, int line);
+    void writeCheckpoint(const World &world, int line);
+    void writeVarint(quint64 value);
+    void flush();
+
+    QFile file;
+    QByteArray buffer; //Written to the file in large pieces
+    quint64 offset = 0; //File position of the end of buffer
+    bool failed = false;
+    quint32 interval = 0;
+    quint64 steps = 0;
+    QVector<quint64> checkpoints; //Offsets
+
+    //State after the last step. Fields a single action can change: Steve's and the one in front of him.
+    Coords steve;
+    ORIENTATION orientation;
+    int line = 0;
+    Coords field_pos[2];
+    WorldObject field[2];
+    int field_count = 0;
+};
+
+class TraceReader
+{
+public:
+    TraceReader() {}
+    ~TraceReader();
+
+    bool loadFile(const QString &filename);
+    quint64 getStepCount() const { return steps; }
+    quint32 getCheckpointInterval() const { return interval; }
+
+    //Restores the world after step (0: before the first one) from the nearest checkpoint before it
+    bool seek(quint64 step, World &world);
+    //Applies the step after the current one
+    bool next(World &world);
+    quint64 getStep() const { return current_step; }
+    int getLine() const { return line; } //Next line to execute after the current step
+
+private:
+    TraceReader(const TraceReader &other) = delete;
+    TraceReader &operator=(const TraceReader &other) = delete;
+
+    void clear();
+    bool readVarint(quint64 &value);
+    bool readCheckpoint(World *world);
+    bool readStep(World &world);
+
+    QFile file;
+    const uchar *data = nullptr;
+    quint64 data_size = 0;
+    QByteArray data_copy;
+
+    quint32 interval = 0;
+    quint64 steps = 0;
+    QVector<quint64> checkpoints;
+
+    quint64 pos = 0;
+    quint64 current_step = 0;
+    int line = 0;
+    bool positioned = false; //pos is valid for next()
+};
+
+#endif // WORLDTRACE_H